@@ -3,201 +3,4149 @@
 #include <numeric>
 #include <algorithm>
 #include <cassert>
+#include <span>
+#include <thread>
+#include <system_error>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <limits>
+#include <climits>
+#include <new>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <typeinfo>
+#include <filesystem>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 using namespace std;
 
+// ---------------------------------------------------------------------------
+// Policies
+//
+// A Monoid policy describes the aggregate kept in every node:
+//   value_type                    type of the aggregate
+//   identity()                    neutral element of combine
+//   combine(a, b)                 aggregate of two adjacent ranges (a on the left)
+//   leaf(x, index)                (optional) aggregate of element x at position
+//                                 index; without it a leaf is value_type(x)
+//   commutative                   (optional) true if combine(a, b) == combine(b, a)
+//
+// An Action policy describes the lazy update applied to whole ranges:
+//   tag_type                      type of a pending update
+//   identity()                    the "no pending update" tag
+//   apply(value, tag, len)        aggregate of a range of len elements after tag
+//   compose(newer, older)         single tag equivalent to older followed by newer
+//   commutative                   (optional) true if tags give the same result in
+//                                 any order, so they can stay on the node they
+//                                 were applied to (PersistentSegmentTree,
+//                                 DynamicSegmentTree)
+//
+// All members are static so that calls through the policies inline away.
+// ---------------------------------------------------------------------------
+
+template <class T>
+struct SumMonoid {
+    using value_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return T(0); }
+    static T combine(const T& a, const T& b) { return a + b; }
+};
+
+template <class T>
+struct MinMonoid {
+    using value_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return numeric_limits<T>::max(); }
+    static T combine(const T& a, const T& b) { return min(a, b); }
+};
+
+template <class T>
+struct MaxMonoid {
+    using value_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return numeric_limits<T>::lowest(); }
+    static T combine(const T& a, const T& b) { return max(a, b); }
+};
+
+template <class T>
+struct XorMonoid {
+    using value_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return T(0); }
+    static T combine(const T& a, const T& b) { return a ^ b; }
+};
+
+template <class T>
+struct GcdMonoid {
+    using value_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return T(0); }
+    static T combine(const T& a, const T& b) { return gcd(a, b); }
+};
+
+// Sum, maximum and minimum of a range together with where they are, so one
+// tree answers every kind of query. argmax/argmin are the leftmost positions
+// of the extremes, -1 for the empty range.
+template <class T>
+struct Summary {
+    T sum, max, min;
+    int argmax, argmin;
+};
+
+template <class T>
+struct SummaryMonoid {
+    using value_type = Summary<T>;
+    static Summary<T> identity() {
+        return {T(0), numeric_limits<T>::lowest(), numeric_limits<T>::max(), -1, -1};
+    }
+    static Summary<T> combine(const Summary<T>& a, const Summary<T>& b) {
+        Summary<T> c;
+        c.sum = a.sum + b.sum;
+        bool left_max = a.argmax != -1 && (b.argmax == -1 || a.max >= b.max);
+        bool left_min = a.argmin != -1 && (b.argmin == -1 || a.min <= b.min);
+        c.max = left_max ? a.max : b.max;
+        c.argmax = left_max ? a.argmax : b.argmax;
+        c.min = left_min ? a.min : b.min;
+        c.argmin = left_min ? a.argmin : b.argmin;
+        return c;
+    }
+    template <class E>
+    static Summary<T> leaf(const E& x, int index) {
+        return {T(x), T(x), T(x), index, index};
+    }
+};
+
+// Aggregate for the best (maximum-sum) contiguous window of a range: the
+// total, the best prefix, the best suffix and the best window, each over
+// at least one element. empty marks the identity (the empty range).
+template <class T>
+struct MaxSubarray {
+    T sum, prefix, suffix, best;
+    bool empty;
+};
+
+template <class T>
+struct MaxSubarrayMonoid {
+    using value_type = MaxSubarray<T>;
+    static MaxSubarray<T> identity() { return {T(0), T(0), T(0), T(0), true}; }
+    static MaxSubarray<T> combine(const MaxSubarray<T>& a, const MaxSubarray<T>& b) {
+        if (a.empty) return b;
+        if (b.empty) return a;
+        return {a.sum + b.sum, max(a.prefix, a.sum + b.prefix), max(b.suffix, b.sum + a.suffix),
+                max({a.best, b.best, a.suffix + b.prefix}), false};
+    }
+    template <class E>
+    static MaxSubarray<T> leaf(const E& x, int) {
+        return {T(x), T(x), T(x), T(x), false};
+    }
+};
+
+// True if a Monoid or Action policy declares itself commutative
+template <class Policy>
+constexpr bool isCommutative() {
+    if constexpr (requires { Policy::commutative; }) {
+        return Policy::commutative;
+    } else {
+        return false;
+    }
+}
+
+// Returns the leaf aggregate of element x at position index: Monoid::leaf
+// if the Monoid defines it, else value_type(x).
+template <class Monoid, class E>
+typename Monoid::value_type makeLeaf(const E& x, int index) {
+    if constexpr (requires { Monoid::leaf(x, index); }) {
+        return Monoid::leaf(x, index);
+    } else {
+        return typename Monoid::value_type(x);
+    }
+}
+
+// Adds a value to every element; the sum of a range grows by value * len.
+// Acc is the type of the sums, Tag the type of the pending additions. The
+// product tag * len is always formed in Acc, so a narrow Tag never
+// overflows while it is scaled up to a whole range. Useful modes:
+//   SumMonoid<int>,       RangeAddSum<int>             int32 throughout (wraps past 2^31)
+//   SumMonoid<long long>, RangeAddSum<long long, int>  int32 tags, int64 sums
+//   SumMonoid<long long>, RangeAddSum<long long>       int64 throughout
+//   SumMonoid<__int128>,  RangeAddSum<__int128, long long>  int64 tags, int128 sums
+// A pending tag is a change of every element below it, so Tag only has
+// to be as wide as the element values themselves.
+template <class Acc, class Tag = Acc>
+struct RangeAddSum {
+    using tag_type = Tag;
+    static constexpr bool commutative = true;
+    static Tag identity() { return Tag(0); }
+    static Acc apply(const Acc& value, const Tag& tag, long long len) { return value + Acc(tag) * Acc(len); }
+    static Tag compose(const Tag& newer, const Tag& older) { return newer + older; }
+};
+
+// Adds a value to every element; the min/max of a range grows by value.
+template <class T>
+struct RangeAdd {
+    using tag_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return T(0); }
+    static T apply(const T& value, const T& tag, long long) { return value + tag; }
+    static T compose(const T& newer, const T& older) { return newer + older; }
+};
+
+// Adds a value to every element of a Summary: the sum grows by value * len,
+// the extremes by value, and their positions stay where they are.
+template <class T>
+struct RangeAddSummary {
+    using tag_type = T;
+    static constexpr bool commutative = true;
+    static T identity() { return T(0); }
+    static Summary<T> apply(const Summary<T>& value, const T& tag, long long len) {
+        if (value.argmax == -1) {
+            return value; // Empty range
+        }
+        return {value.sum + tag * T(len), value.max + tag, value.min + tag, value.argmax, value.argmin};
+    }
+    static T compose(const T& newer, const T& older) { return newer + older; }
+};
+
+// Combined tag for range assignment and range addition: every element x
+// below the tag becomes (has_set ? set : x) + add. A plain value converts
+// to an addition, so updateRange(l, r, v) still adds v.
+template <class T>
+struct AssignAddTag {
+    bool has_set = false;
+    T set = T(0);
+    T add = T(0);
+
+    AssignAddTag(T add_value = T(0)) : add(add_value) {}
+
+    bool operator==(const AssignAddTag& other) const {
+        return has_set == other.has_set && set == other.set && add == other.add;
+    }
+};
+
+// Composition shared by the assign+add actions: a newer assignment wipes
+// out everything older, otherwise additions accumulate on top.
+template <class T>
+struct AssignAddCompose {
+    using tag_type = AssignAddTag<T>;
+    static tag_type identity() { return tag_type(); }
+    static tag_type assign(const T& value) {
+        tag_type tag;
+        tag.has_set = true;
+        tag.set = value;
+        return tag;
+    }
+    static tag_type compose(const tag_type& newer, const tag_type& older) {
+        if (newer.has_set) {
+            return newer;
+        }
+        tag_type result = older;
+        result.add += newer.add;
+        return result;
+    }
+};
+
+// Range assign and range add over sums. Acc is the type of the sums,
+// T the type of the tag values (see RangeAddSum).
+template <class Acc, class T = Acc>
+struct RangeAssignAddSum : AssignAddCompose<T> {
+    static Acc apply(const Acc& value, const AssignAddTag<T>& tag, long long len) {
+        Acc base = tag.has_set ? Acc(tag.set) * Acc(len) : value;
+        return base + Acc(tag.add) * Acc(len);
+    }
+};
+
+// Range assign and range add over min/max.
+template <class T>
+struct RangeAssignAdd : AssignAddCompose<T> {
+    static T apply(const T& value, const AssignAddTag<T>& tag, long long) {
+        return (tag.has_set ? tag.set : value) + tag.add;
+    }
+};
+
+// Modular arithmetic policies for the modular monoid and action below.
+// A Mod policy provides, for values already reduced into [0, modulus()):
+//   modulus()      the modulus, 1 <= modulus() < 2^31
+//   add(a, b)      (a + b) mod modulus()
+//   mul(a, b)      (a * b) mod modulus()
+
+// Compile-time modulus. The compiler already turns % by a constant into a
+// multiply and shift, so this is the fast path for a fixed prime.
+template <uint32_t M>
+struct StaticMod {
+    static_assert(1 <= M && M < (1u << 31));
+    static constexpr uint32_t modulus() { return M; }
+    static uint32_t add(uint32_t a, uint32_t b) {
+        uint32_t c = a + b;
+        return c >= M ? c - M : c;
+    }
+    static uint32_t mul(uint32_t a, uint32_t b) { return (uint32_t)((uint64_t)a * b % M); }
+};
+
+// Modulus chosen at run time with setModulus (one per Id), reduced with
+// Barrett's method: a 64-bit product is divided by multiplying with a
+// precomputed 2^64 / modulus instead of a hardware division. Values stay in
+// normal form, so leaves and query results need no conversion (unlike
+// Montgomery form).
+template <int Id = 0>
+struct BarrettMod {
+    inline static uint32_t m = 998244353;
+    inline static uint64_t im = ~0ULL / 998244353 + 1; // ceil(2^64 / m)
+
+    static void setModulus(uint32_t modulus) {
+        assert(1 <= modulus && modulus < (1u << 31));
+        m = modulus;
+        im = ~0ULL / modulus + 1;
+    }
+    static uint32_t modulus() { return m; }
+    static uint32_t add(uint32_t a, uint32_t b) {
+        uint32_t c = a + b;
+        return c >= m ? c - m : c;
+    }
+    static uint32_t mul(uint32_t a, uint32_t b) {
+        uint64_t z = (uint64_t)a * b;
+        uint64_t x = (uint64_t)(((unsigned __int128)z * im) >> 64); // z / m, or one more since im rounds up
+        uint64_t y = x * m;
+        return (uint32_t)(z - y + (z < y ? m : 0));
+    }
+};
+
+// Sum modulo Mod::modulus(). Leaves are reduced from any integer, negative
+// ones included.
+template <class Mod>
+struct ModSumMonoid {
+    using value_type = uint32_t;
+    static uint32_t identity() { return 0; }
+    static uint32_t combine(uint32_t a, uint32_t b) { return Mod::add(a, b); }
+    template <class E>
+    static uint32_t leaf(const E& x, int) {
+        long long r = (long long)x % (long long)Mod::modulus();
+        return (uint32_t)(r < 0 ? r + Mod::modulus() : r);
+    }
+};
+
+// Affine map x -> mul * x + add, the tag of RangeAffineMod
+struct AffineTag {
+    uint32_t mul = 1;
+    uint32_t add = 0;
+
+    bool operator==(const AffineTag& other) const { return mul == other.mul && add == other.add; }
+};
+
+// Sets every element x to x * b + c (mod Mod::modulus()), with b and c
+// already reduced; updateRange(l, r, AffineTag{b, c}). The sum of a range
+// of len elements becomes b * sum + c * len.
+template <class Mod>
+struct RangeAffineMod {
+    using tag_type = AffineTag;
+    static AffineTag identity() { return AffineTag(); }
+    static uint32_t apply(uint32_t value, const AffineTag& tag, long long len) {
+        uint32_t scaled_len = (uint32_t)(len % Mod::modulus());
+        return Mod::add(Mod::mul(tag.mul, value), Mod::mul(tag.add, scaled_len));
+    }
+    // newer(older(x)) = newer.mul * (older.mul * x + older.add) + newer.add
+    static AffineTag compose(const AffineTag& newer, const AffineTag& older) {
+        return {Mod::mul(newer.mul, older.mul), Mod::add(Mod::mul(newer.mul, older.add), newer.add)};
+    }
+};
+
+// Pending range assignment: every element below the tag becomes set
+template <class T>
+struct AssignTag {
+    bool has_set = false;
+    T set = T(0);
+
+    bool operator==(const AssignTag& other) const {
+        return has_set == other.has_set && (!has_set || set == other.set);
+    }
+};
+
+// Range assignment on MaxSubarray aggregates, through assignRange(l, r, v).
+// len copies of v sum to v * len; the best window is all of them when v > 0
+// and a single element otherwise.
+template <class T>
+struct RangeAssignMaxSubarray {
+    using tag_type = AssignTag<T>;
+    static AssignTag<T> identity() { return AssignTag<T>(); }
+    static AssignTag<T> assign(const T& val) { return {true, val}; }
+    static MaxSubarray<T> apply(const MaxSubarray<T>& value, const AssignTag<T>& tag, long long len) {
+        if (!tag.has_set || value.empty) {
+            return value;
+        }
+        T sum = tag.set * T(len);
+        T best = tag.set > T(0) ? sum : tag.set;
+        return {sum, best, best, best, false};
+    }
+    static AssignTag<T> compose(const AssignTag<T>& newer, const AssignTag<T>& older) {
+        return newer.has_set ? newer : older;
+    }
+};
+
+// No range updates at all, for static trees (xor, gcd, ...).
+struct NoTag {
+    bool operator==(const NoTag&) const { return true; }
+};
+
+template <class T>
+struct NoAction {
+    using tag_type = NoTag;
+    static constexpr bool commutative = true;
+    static NoTag identity() { return NoTag(); }
+    static T apply(const T& value, NoTag, long long) { return value; }
+    static NoTag compose(NoTag, NoTag) { return NoTag(); }
+};
+
+// Allocator for the node arrays: aligns them to a cache line so that a
+// layout's blocks line up with the lines they are meant to fill.
+template <class T>
+struct CacheAlignedAllocator {
+    using value_type = T;
+    static constexpr size_t ALIGNMENT = 64;
+
+    CacheAlignedAllocator() = default;
+    template <class U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), align_val_t(ALIGNMENT)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, align_val_t(ALIGNMENT));
+    }
+    template <class U>
+    bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+};
+
+template <class T>
+using aligned_vector = vector<T, CacheAlignedAllocator<T>>;
+
+// ---------------------------------------------------------------------------
+// Node layouts
+//
+// SegmentTree navigates with heap indices (root 1, children 2*i and 2*i+1);
+// a Layout policy maps each heap index to a slot in the tree/lazy arrays:
+//   init(n)          prepares the mapping for an array of n elements
+//   size()           number of slots to allocate
+//   index(node)      slot of heap index node
+// ---------------------------------------------------------------------------
+
+// Classic heap order: slot == heap index. Deep levels are far apart in
+// memory, so a root-to-leaf walk touches a new cache line on every level
+// once the tree no longer fits in cache.
+struct HeapLayout {
+    size_t nodes = 0;
+
+    void init(int n) { nodes = 4 * (size_t)n; } // Segment tree needs up to 4*n space
+    size_t size() const { return nodes; }
+    size_t index(int node) const { return node; }
+};
+
+// Blocked-subtree order: the tree is cut into subtrees of H levels and
+// each subtree is stored contiguously (in heap order inside the block),
+// blocks in breadth-first order. A block of 2^H - 1 nodes is padded to 2^H
+// slots, so with 64-byte aligned arrays and H = 4 every block of 4-byte
+// values is exactly one cache line, and a root-to-leaf walk touches one
+// line per H levels instead of one line per level.
+template <int H = 4>
+struct BlockedLayout {
+    int depth = 0;     // Deepest level used by an n-element tree
+    size_t slots = 0;  // Total number of slots, padding included
+    // Per tree level d, for a node at that level:
+    //   shift[d]   its level inside its block (node >> shift[d] is the block root)
+    //   stride[d]  slots per block on its block level
+    //   offset[d]  constant part of its slot, so that
+    //              slot = offset[d] + (node >> shift[d]) * stride[d] + (node & mask)
+    int shift[32];
+    size_t stride[32];
+    size_t offset[32];
+
+    void init(int n) {
+        depth = 0;
+        while ((1LL << depth) < n) {
+            ++depth;
+        }
+        int last_level = depth / H;
+        size_t base = 0; // First slot of the current block level
+        for (int k = 0; k <= last_level; ++k) {
+            size_t first = (size_t)1 << (k * H); // Heap index of the first block root
+            int height = k == last_level ? depth + 1 - k * H : H;
+            size_t block = (size_t)1 << height;
+            for (int d = k * H; d < k * H + height; ++d) {
+                shift[d] = d - k * H;
+                stride[d] = block;
+                // Unsigned wrap-around is intended; the full sum is in range.
+                offset[d] = base - first * block + ((size_t)1 << shift[d]);
+            }
+            base += first * block;
+        }
+        slots = base;
+    }
+
+    size_t size() const { return slots; }
+
+    size_t index(int node) const {
+        int d = 31 - __builtin_clz((unsigned)node);
+        size_t root = (size_t)(node >> shift[d]);
+        return offset[d] + root * stride[d] + ((size_t)node & (((size_t)1 << shift[d]) - 1));
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Node storage
+//
+// A Storage policy decides how the per-node aggregate and pending tag are
+// kept in memory. Storage::nodes<V, Tag> provides:
+//   resize(count, none)   allocates count slots with every tag set to none
+//   value(slot), tag(slot) references to the aggregate and tag of a slot
+// and Storage::can_be_read_only tells whether a tree may hold read-only nodes
+// (so SegmentTree only checks before writes when it is true).
+// ---------------------------------------------------------------------------
+
+// Two parallel arrays (structure of arrays). A push or an update reads the
+// aggregate and the tag of a node from two different cache lines.
+struct SplitStorage {
+    static constexpr bool can_be_read_only = false;
+
+    template <class V, class Tag>
+    struct nodes {
+        aligned_vector<V> values;
+        aligned_vector<Tag> tags;
+
+        void resize(size_t count, const Tag& none) {
+            values.resize(count);
+            tags.resize(count, none);
+        }
+        V& value(size_t slot) { return values[slot]; }
+        Tag& tag(size_t slot) { return tags[slot]; }
+        const V& value(size_t slot) const { return values[slot]; }
+        const Tag& tag(size_t slot) const { return tags[slot]; }
+    };
+};
+
+// One array of {aggregate, tag} pairs (array of structures). The pair is
+// aligned to its own power-of-two size, so it never straddles a cache line
+// and a node costs one line instead of two.
+struct PackedStorage {
+    static constexpr bool can_be_read_only = false;
+
+    template <class V, class Tag>
+    struct nodes {
+        static constexpr size_t PAIR_SIZE = sizeof(V) + sizeof(Tag);
+        static constexpr size_t PAIR_ALIGN = PAIR_SIZE <= 8 ? 8 : PAIR_SIZE <= 16 ? 16
+                                           : PAIR_SIZE <= 32 ? 32 : 64;
+        struct alignas(PAIR_ALIGN) Node {
+            V value;
+            Tag tag;
+        };
+        aligned_vector<Node> data;
+
+        void resize(size_t count, const Tag& none) {
+            data.resize(count, Node{V(), none});
+        }
+        V& value(size_t slot) { return data[slot].value; }
+        Tag& tag(size_t slot) { return data[slot].tag; }
+        const V& value(size_t slot) const { return data[slot].value; }
+        const Tag& tag(size_t slot) const { return data[slot].tag; }
+    };
+};
+
+// ---------------------------------------------------------------------------
+// On-disk format
+//
+// SegmentTree::save writes the node arrays to a file that a tree with
+// MappedStorage maps back in O(1): nothing is read or rebuilt, pages fault
+// in the first time a query touches them. File layout (little-endian,
+// every section starts on a TREE_FILE_ALIGN boundary):
+//   [0, TREE_FILE_ALIGN)        TreeFileHeader, zero padded
+//   [values_offset, ...)        value_type of every slot, in Layout order
+//   [tags_offset, ...)          tag_type of every slot, in Layout order
+// The header records the format version, the policies and value types the
+// file was written with (hashes of their type names, so a file is only
+// portable between builds of the same compiler), n and the slot count, and
+// checksums of the header and of both arrays.
+// ---------------------------------------------------------------------------
+
+constexpr uint32_t TREE_FILE_VERSION = 1;
+constexpr size_t TREE_FILE_ALIGN = 4096; // One page, so each array can be mapped page-aligned
+
+// 64-bit checksum over a byte stream, 8 bytes at a time. update() may be
+// called repeatedly; every call but the last must pass a multiple of 8 bytes.
+class Checksum64 {
+private:
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    uint64_t bytes = 0;
+
+    void mix(uint64_t word) {
+        h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 29;
+    }
+
+public:
+    void update(const void* data, size_t length) {
+        const char* p = static_cast<const char*>(data);
+        size_t words = length / 8;
+        for (size_t i = 0; i < words; ++i) {
+            uint64_t word;
+            memcpy(&word, p + 8 * i, 8);
+            mix(word);
+        }
+        if (length % 8 != 0) {
+            uint64_t word = 0;
+            memcpy(&word, p + 8 * words, length % 8);
+            mix(word);
+        }
+        bytes += length;
+    }
+
+    uint64_t digest() const {
+        uint64_t d = (h ^ bytes) * 0xC4CEB9FE1A85EC53ULL;
+        return d ^ (d >> 32);
+    }
+};
+
+// Identifies a policy or value type in a file header
+template <class T>
+uint64_t typeHash() {
+    Checksum64 sum;
+    const char* name = typeid(T).name();
+    sum.update(name, strlen(name));
+    return sum.digest();
+}
+
+struct TreeFileHeader {
+    char magic[8];             // "SEGTREE\0"
+    uint32_t version;          // TREE_FILE_VERSION
+    uint32_t header_bytes;     // sizeof(TreeFileHeader)
+    uint64_t monoid, action, layout;   // typeHash of the policies
+    uint64_t value_type, tag_type;     // typeHash of the stored types
+    uint32_t value_size, tag_size;     // sizeof of the stored types
+    int64_t n;                 // Size of the original array
+    uint64_t slots;            // Layout::size(), entries in each array
+    uint64_t values_offset, tags_offset, file_bytes;
+    uint64_t values_checksum, tags_checksum;
+    uint64_t header_checksum;  // Checksum of the header with this field zeroed
+};
+
+static_assert(sizeof(TreeFileHeader) <= TREE_FILE_ALIGN);
+
+enum class MapMode {
+    ReadOnly,    // Pages are shared with the page cache; only the const methods
+                 // work, the others throw runtime_error
+    CopyOnWrite  // Updates work and copy the pages they touch; the file is never written
+};
+
+#ifdef __linux__
+// Node arrays in an mmap-ed region: either anonymous memory (when the tree
+// is built from an array) or a file written by SegmentTree::save, opened
+// through SegmentTree's file constructor. Values and tags are kept as two
+// arrays, as in SplitStorage.
+struct MappedStorage {
+    static constexpr bool can_be_read_only = true; // MapMode::ReadOnly files
+
+    template <class V, class Tag>
+    struct nodes {
+        static_assert(is_trivially_copyable_v<V> && is_trivially_copyable_v<Tag>,
+                      "mapped nodes are used in place without construction");
+
+        char* base = nullptr; // Start of the mapping
+        size_t length = 0;    // Bytes mapped
+        V* values = nullptr;
+        Tag* tags = nullptr;
+
+        nodes() = default;
+        nodes(const nodes&) = delete;
+        nodes& operator=(const nodes&) = delete;
+        ~nodes() { release(); }
+
+        void release() {
+            if (base != nullptr) {
+                munmap(base, length);
+            }
+            base = nullptr;
+            length = 0;
+            values = nullptr;
+            tags = nullptr;
+        }
+
+        void resize(size_t count, const Tag& none) {
+            release();
+            size_t values_bytes = (count * sizeof(V) + TREE_FILE_ALIGN - 1) / TREE_FILE_ALIGN * TREE_FILE_ALIGN;
+            if (count == 0) return;
+            length = values_bytes + count * sizeof(Tag);
+            void* region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (region == MAP_FAILED) {
+                length = 0;
+                throw bad_alloc();
+            }
+            base = static_cast<char*>(region);
+            values = reinterpret_cast<V*>(base);
+            tags = reinterpret_cast<Tag*>(base + values_bytes);
+            fill_n(values, count, V());
+            fill_n(tags, count, none);
+        }
+
+        // Maps the whole file at path. Throws runtime_error if it cannot be
+        // opened or mapped. The arrays are set later by attach().
+        void map(const string& path, MapMode mode) {
+            release();
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw runtime_error("cannot open " + path);
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TreeFileHeader)) {
+                close(fd);
+                throw runtime_error("not a segment tree file: " + path);
+            }
+            int protection = mode == MapMode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+            void* region = mmap(nullptr, info.st_size, protection, MAP_PRIVATE, fd, 0);
+            close(fd); // The mapping keeps the file alive
+            if (region == MAP_FAILED) {
+                throw runtime_error("cannot map " + path);
+            }
+            base = static_cast<char*>(region);
+            length = info.st_size;
+        }
+
+        // Points the arrays at their offsets inside the mapping
+        void attach(size_t values_offset, size_t tags_offset) {
+            values = reinterpret_cast<V*>(base + values_offset);
+            tags = reinterpret_cast<Tag*>(base + tags_offset);
+        }
+
+        V& value(size_t slot) { return values[slot]; }
+        Tag& tag(size_t slot) { return tags[slot]; }
+        const V& value(size_t slot) const { return values[slot]; }
+        const Tag& tag(size_t slot) const { return tags[slot]; }
+    };
+};
+#endif
+
+// Work counters of SegmentTree operations. They are only maintained when
+// compiled with -DSEGMENT_TREE_STATS; otherwise they are compiled out and
+// the accessors return zeros.
+struct SegmentTreeStats {
+    uint64_t operations = 0;    // Public updates and queries (a batch counts once)
+    uint64_t nodes_visited = 0; // Recursive calls, including ones that return at once
+    uint64_t pushes = 0;        // push calls that found a pending tag and propagated it
+    uint64_t tag_writes = 0;    // Child tags composed by pushes and by covering updates
+    uint64_t splits = 0;        // Partial overlaps that recursed into the children
+    uint64_t max_depth = 0;     // Deepest node visited (root = 0)
+
+    SegmentTreeStats& operator+=(const SegmentTreeStats& other) {
+        operations += other.operations;
+        nodes_visited += other.nodes_visited;
+        pushes += other.pushes;
+        tag_writes += other.tag_writes;
+        splits += other.splits;
+        max_depth = max(max_depth, other.max_depth);
+        return *this;
+    }
+};
+
+template <class Monoid = SumMonoid<int>, class Action = RangeAddSum<int>, class Layout = HeapLayout,
+          class Storage = SplitStorage>
 class SegmentTree {
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+
+    // One range update of a batch: applies 'val' to arr[l...r]
+    struct Update {
+        int l, r;
+        tag_type val;
+    };
+
 private:
-    vector<int> tree; // Stores the sum of the range for each node
-    vector<int> lazy; // Stores the pending update value for each node
+    // Stores the aggregate of the range (value) and the pending update (tag)
+    // for each node
+    typename Storage::template nodes<value_type, tag_type> nodes;
+    Layout layout;        // Maps heap indices to slots in nodes
     int n;                // Size of the original array (elements are 0-indexed)
+    bool read_only = false; // Opened with MapMode::ReadOnly: the pages cannot be written
     const int ROOT_NODE = 1; // Root of the segment tree is at index 1
 
+    // One entry of a batch traversal: the range of an update or query and
+    // its id (the update's tag in batch_tags, or the query's result slot).
+    // Update entries built by an ancestor from updates that covered it
+    // completely get the range [INT_MIN, INT_MAX].
+    struct BatchEntry {
+        int l, r;
+        int id;
+    };
+    // Scratch space of applyBatch/queryBatch, kept between calls to avoid reallocating
+    vector<BatchEntry> batch_entries;
+    vector<tag_type> batch_tags;
+
+#ifdef SEGMENT_TREE_STATS
+    // Counters of the current (or last) operation and of all operations.
+    // Also written by the const queryRange, which is then not thread-safe.
+    mutable SegmentTreeStats op_stats, total_stats;
+#endif
+
+    // Scope of one public operation: resets the operation counters on
+    // construction and adds them to the totals on destruction. Empty unless
+    // SEGMENT_TREE_STATS is defined.
+    struct StatsScope {
+#ifdef SEGMENT_TREE_STATS
+        const SegmentTree& tree;
+        explicit StatsScope(const SegmentTree& t) : tree(t) {
+            tree.op_stats = SegmentTreeStats();
+            tree.op_stats.operations = 1;
+        }
+        ~StatsScope() { tree.total_stats += tree.op_stats; }
+#else
+        explicit StatsScope(const SegmentTree&) {}
+#endif
+    };
+
+    // Helper functions to count work; no-ops unless SEGMENT_TREE_STATS is defined
+    void count_visit(int node) const {
+#ifdef SEGMENT_TREE_STATS
+        ++op_stats.nodes_visited;
+        op_stats.max_depth = max(op_stats.max_depth, (uint64_t)(31 - __builtin_clz((unsigned)node)));
+#else
+        (void)node;
+#endif
+    }
+    void count_split() const {
+#ifdef SEGMENT_TREE_STATS
+        ++op_stats.splits;
+#endif
+    }
+    void count_tag_writes(int writes, bool from_push) const {
+#ifdef SEGMENT_TREE_STATS
+        op_stats.tag_writes += writes;
+        op_stats.pushes += from_push;
+#else
+        (void)writes;
+        (void)from_push;
+#endif
+    }
+
+    // Helper function to reject operations that write nodes on a tree
+    // opened with MapMode::ReadOnly, whose pages would fault on the write.
+    // Compiles to nothing for storages that are never read-only.
+    void check_writable(const char* operation) const {
+        if constexpr (Storage::can_be_read_only) {
+            if (read_only) {
+                throw runtime_error(string(operation) + " writes to the tree, which was opened with MapMode::ReadOnly");
+            }
+        } else {
+            (void)operation;
+        }
+    }
+
     // Helper function to push lazy updates down to children
     // node: current segment tree node index
     // start, end: range covered by this node
     void push(int node, int start, int end) {
-        if (lazy[node] != 0) {
-            tree[node] += lazy[node] * (int)(end - start + 1);
+        size_t self = layout.index(node);
+        if (!(nodes.tag(self) == Action::identity())) {
+            nodes.value(self) = Action::apply(nodes.value(self), nodes.tag(self), end - start + 1);
+
+            if (start != end) {
+                size_t left = layout.index(2 * node), right = layout.index(2 * node + 1);
+                nodes.tag(left) = Action::compose(nodes.tag(self), nodes.tag(left));
+                nodes.tag(right) = Action::compose(nodes.tag(self), nodes.tag(right));
+            }
+            count_tag_writes(start != end ? 2 : 0, true);
+            nodes.tag(self) = Action::identity();
+        }
+    }
+
+    // Helper function to apply 'tag' to the whole range of a pushed node:
+    // to its value now, and to its children through their tags
+    void apply_tag(int node, int start, int end, const tag_type& tag) {
+        size_t self = layout.index(node);
+        nodes.value(self) = Action::apply(nodes.value(self), tag, end - start + 1);
+        if (start != end) {
+            size_t left = layout.index(2 * node), right = layout.index(2 * node + 1);
+            nodes.tag(left) = Action::compose(tag, nodes.tag(left));
+            nodes.tag(right) = Action::compose(tag, nodes.tag(right));
+            count_tag_writes(2, false);
+        }
+    }
+
+    // Helper function to recompute a node from its children
+    void pull(int node) {
+        nodes.value(layout.index(node)) = Monoid::combine(nodes.value(layout.index(2 * node)),
+                                                          nodes.value(layout.index(2 * node + 1)));
+    }
+
+    // Recursive function to build the segment tree
+    // arr: initial array
+    // node: current segment tree node index
+    // start, end: range covered by this node (0-indexed based on original array)
+    template <class E>
+    void build_recursive(const vector<E>& arr, int node, int start, int end) {
+        if (start == end) {
+            nodes.value(layout.index(node)) = makeLeaf<Monoid>(arr[start], start);
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        build_recursive(arr, 2 * node, start, mid);
+        build_recursive(arr, 2 * node + 1, mid + 1, end);
+        pull(node);
+    }
+
+    // Recursive function to build the segment tree on several threads
+    // Same as build_recursive, but while 'spawn' > 0 the left half is built
+    // on a new thread (with spawn - 1) and the right half on this one.
+    template <class E>
+    void build_parallel(const vector<E>& arr, int node, int start, int end, int spawn) {
+        if (spawn == 0 || start == end) {
+            build_recursive(arr, node, start, end);
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        thread left;
+        try {
+            left = thread([&] { build_parallel(arr, 2 * node, start, mid, spawn - 1); });
+        } catch (const system_error&) {
+            build_recursive(arr, 2 * node, start, mid); // No thread available: build it here
+        }
+        build_parallel(arr, 2 * node + 1, mid + 1, end, spawn - 1);
+        if (left.joinable()) {
+            left.join();
+        }
+        pull(node);
+    }
 
+    // Recursive function for range updates
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    // l, r: update range query (0-indexed)
+    // val: update to apply
+    void update_recursive(int node, int start, int end, int l, int r, const tag_type& val) {
+        count_visit(node);
+        push(node, start, end);
+
+        // Case 1: Current segment [start, end] is completely outside the update range [l, r]
+        if (start > end || start > r || end < l) {
+            return;
+        }
+
+        // Case 2: Current segment [start, end] is completely inside the update range [l, r]
+        if (l <= start && end <= r) {
+            size_t self = layout.index(node);
+            nodes.value(self) = Action::apply(nodes.value(self), val, end - start + 1);
             if (start != end) {
-                lazy[2 * node] += lazy[node];
-                lazy[2 * node + 1] += lazy[node];
+                size_t left = layout.index(2 * node), right = layout.index(2 * node + 1);
+                nodes.tag(left) = Action::compose(val, nodes.tag(left));
+                nodes.tag(right) = Action::compose(val, nodes.tag(right));
+                count_tag_writes(2, false);
+            }
+            return;
+        }
+
+        // Case 3: Partial overlap. Recurse on children.
+        count_split();
+        int mid = start + (end - start) / 2;
+        update_recursive(2 * node, start, mid, l, r, val);
+        update_recursive(2 * node + 1, mid + 1, end, l, r, val);
+
+        pull(node);
+    }
+
+    // Recursive function for batched range updates
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    // entries[first, last): the updates reaching this node, in batch order.
+    //      Lists for the children are appended past 'last' and removed afterwards.
+    // tags: tags of the entries; folded tags are appended and removed likewise.
+    void batch_recursive(int node, int start, int end, vector<BatchEntry>& entries,
+                         vector<tag_type>& tags, size_t first, size_t last) {
+        // A lone update continues as a plain updateRange walk, which is cheaper per node
+        if (last - first == 1) {
+            BatchEntry e = entries[first];
+            update_recursive(node, start, end, e.l, e.r, tags[e.id]);
+            return;
+        }
+        count_visit(node);
+        push(node, start, end);
+
+        // Fold every run of consecutive updates covering [start, end] into one
+        // tag. A run before the first partial update is applied to this node
+        // right away, and one after the last partial update once the children
+        // are done; any other run costs the children one entry whatever its length.
+        size_t compressed = entries.size(), tags_size = tags.size();
+        bool has_run = false, has_partial = false;
+        tag_type run = Action::identity();
+        for (size_t i = first; i < last; ++i) {
+            BatchEntry e = entries[i];
+            if (e.l <= start && end <= e.r) {
+                run = Action::compose(tags[e.id], run);
+                has_run = true;
+                continue;
+            }
+            if (has_run && !has_partial) {
+                apply_tag(node, start, end, run);
+            } else if (has_run) {
+                tags.push_back(run);
+                entries.push_back({INT_MIN, INT_MAX, (int)tags.size() - 1});
+            }
+            run = Action::identity();
+            has_run = false;
+            entries.push_back(e);
+            has_partial = true;
+        }
+
+        // Case 1: Everything covers [start, end]. Apply the single folded tag here.
+        if (!has_partial) {
+            entries.resize(compressed);
+            apply_tag(node, start, end, run);
+            return;
+        }
+
+        // Case 2: Split the list between the children, keeping batch order, so
+        // this node is pushed and pulled once for the whole batch.
+        count_split();
+        size_t children = entries.size();
+        int mid = start + (end - start) / 2;
+        for (int side = 0; side < 2; ++side) {
+            int child_start = side == 0 ? start : mid + 1;
+            int child_end = side == 0 ? mid : end;
+            for (size_t i = compressed; i < children; ++i) {
+                BatchEntry e = entries[i];
+                if (e.l <= child_end && child_start <= e.r) {
+                    entries.push_back(e);
+                }
             }
-            lazy[node] = 0;
+            if (entries.size() > children) {
+                batch_recursive(2 * node + side, child_start, child_end, entries, tags,
+                                children, entries.size());
+            } else {
+                push(2 * node + side, child_start, child_end); // Keep the pull below exact
+            }
+            entries.resize(children);
+        }
+        entries.resize(compressed);
+        tags.resize(tags_size);
+
+        pull(node);
+        if (has_run) {
+            apply_tag(node, start, end, run);
+        }
+    }
+
+    // Recursive function for batched range updates with a commutative Action
+    // Same as batch_recursive, but since the order of the updates does not
+    // matter, every update covering [start, end] is folded into one tag and
+    // the rest are split between the children in place, as in
+    // query_batch_recursive.
+    // entries[first, last): the updates overlapping [start, end]. They are
+    //      reordered in place (the set is kept); children get subranges.
+    // tags: tags of the entries
+    void batch_unordered_recursive(int node, int start, int end, vector<BatchEntry>& entries,
+                                   const vector<tag_type>& tags, size_t first, size_t last) {
+        if (last - first == 1) {
+            BatchEntry e = entries[first];
+            update_recursive(node, start, end, e.l, e.r, tags[e.id]);
+            return;
+        }
+        count_visit(node);
+        push(node, start, end);
+
+        // Updates covering [start, end] move to the front and fold into 'run'
+        size_t open = first;
+        tag_type run = Action::identity();
+        for (size_t i = first; i < last; ++i) {
+            BatchEntry e = entries[i];
+            if (e.l <= start && end <= e.r) {
+                run = Action::compose(tags[e.id], run);
+                swap(entries[i], entries[open++]);
+            }
+        }
+        if (open > first) {
+            apply_tag(node, start, end, run);
+        }
+        if (open == last) {
+            return;
+        }
+
+        // Partial overlaps, split as in query_batch_recursive. A child that
+        // no update reaches is still pushed, to keep the pull below exact.
+        count_split();
+        int mid = start + (end - start) / 2;
+        auto begin = entries.begin();
+        size_t left_end = partition(begin + open, begin + last,
+                                    [mid](const BatchEntry& e) { return e.l <= mid; }) - begin;
+        if (open < left_end) {
+            batch_unordered_recursive(2 * node, start, mid, entries, tags, open, left_end);
+        } else {
+            push(2 * node, start, mid);
+        }
+        size_t right_begin = partition(begin + open, begin + left_end,
+                                       [mid](const BatchEntry& e) { return e.r <= mid; }) - begin;
+        if (right_begin < last) {
+            batch_unordered_recursive(2 * node + 1, mid + 1, end, entries, tags, right_begin, last);
+        } else {
+            push(2 * node + 1, mid + 1, end);
+        }
+
+        pull(node);
+    }
+
+    // Recursive function for read-only range queries ("mark permanence")
+    // Same as query_recursive, but instead of pushing tags it carries
+    // pending, the composition of all ancestors' tags (newest first), and
+    // applies it to the nodes it returns. Nothing is written.
+    value_type query_const_recursive(int node, int start, int end, int l, int r,
+                                     tag_type pending) const {
+        count_visit(node);
+
+        // Case 1: Current segment [start, end] is completely outside the query range [l, r]
+        if (start > end || start > r || end < l) {
+            return Monoid::identity();
+        }
+
+        size_t self = layout.index(node);
+        pending = Action::compose(pending, nodes.tag(self));
+
+        // Case 2: Current segment [start, end] is completely inside the query range [l, r]
+        if (l <= start && end <= r) {
+            return Action::apply(nodes.value(self), pending, end - start + 1);
+        }
+
+        // Case 3: Partial overlap. Recurse on children and combine results.
+        count_split();
+        int mid = start + (end - start) / 2;
+        value_type p1 = query_const_recursive(2 * node, start, mid, l, r, pending);
+        value_type p2 = query_const_recursive(2 * node + 1, mid + 1, end, l, r, pending);
+        return Monoid::combine(p1, p2);
+    }
+
+    // Recursive function for batched range queries
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    // entries[first, last): the queries overlapping [start, end]. They are
+    //      reordered in place (the set is kept); children get subranges.
+    // results: one partial answer per query, extended left to right
+    void query_batch_recursive(int node, int start, int end, vector<BatchEntry>& entries,
+                               span<value_type> results, size_t first, size_t last) {
+        // A lone query continues as a plain queryRange walk, which is cheaper per node
+        if (last - first == 1) {
+            BatchEntry e = entries[first];
+            results[e.id] = Monoid::combine(results[e.id], query_recursive(node, start, end, e.l, e.r));
+            return;
+        }
+        count_visit(node);
+        push(node, start, end);
+
+        // Case 1: Queries covering [start, end] take this node's aggregate and
+        // move to the front. Since children are visited left to right, pieces
+        // arrive in range order.
+        size_t self = layout.index(node);
+        size_t open = first;
+        for (size_t i = first; i < last; ++i) {
+            BatchEntry e = entries[i];
+            if (e.l <= start && end <= e.r) {
+                results[e.id] = Monoid::combine(results[e.id], nodes.value(self));
+                swap(entries[i], entries[open++]);
+            }
+        }
+        if (open == last) {
+            return;
+        }
+
+        // Case 2: Partial overlaps. Start loading both children while the lists
+        // are partitioned. The queries reaching the left child (l <= mid) go
+        // first; after it returns, the ones among them that also reach the
+        // right child (r > mid) are moved next to those that only reach the right.
+        count_split();
+        size_t left = layout.index(2 * node), right = layout.index(2 * node + 1);
+        __builtin_prefetch(&nodes.value(left));
+        __builtin_prefetch(&nodes.tag(left));
+        __builtin_prefetch(&nodes.value(right));
+        __builtin_prefetch(&nodes.tag(right));
+        int mid = start + (end - start) / 2;
+        auto begin = entries.begin();
+        size_t left_end = partition(begin + open, begin + last,
+                                    [mid](const BatchEntry& e) { return e.l <= mid; }) - begin;
+        if (open < left_end) {
+            query_batch_recursive(2 * node, start, mid, entries, results, open, left_end);
+        }
+        size_t right_begin = partition(begin + open, begin + left_end,
+                                       [mid](const BatchEntry& e) { return e.r <= mid; }) - begin;
+        if (right_begin < last) {
+            query_batch_recursive(2 * node + 1, mid + 1, end, entries, results, right_begin, last);
+        }
+    }
+
+    // Recursive function for range queries
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    // l, r: query range (0-indexed)
+    value_type query_recursive(int node, int start, int end, int l, int r) {
+        count_visit(node);
+
+        // Case 1: Current segment [start, end] is completely outside the query range [l, r]
+        if (start > end || start > r || end < l) {
+            return Monoid::identity();
+        }
+
+        push(node, start, end);
+
+        // Case 2: Current segment [start, end] is completely inside the query range [l, r]
+        if (l <= start && end <= r) {
+            return nodes.value(layout.index(node));
+        }
+
+        // Case 3: Partial overlap. Recurse on children and combine results.
+        count_split();
+        int mid = start + (end - start) / 2;
+        value_type p1 = query_recursive(2 * node, start, mid, l, r);
+        value_type p2 = query_recursive(2 * node + 1, mid + 1, end, l, r);
+        return Monoid::combine(p1, p2);
+    }
+
+    // Helper function to walk from the root down to the leaf of arr[i]
+    // Pushes every node on the path and the sibling of each, so that once
+    // the leaf is changed, pull_path can recompute the path. Returns the
+    // heap index of the leaf.
+    int push_path(int i) {
+        int node = ROOT_NODE, start = 0, end = n - 1;
+        while (true) {
+            count_visit(node);
+            push(node, start, end);
+            if (start == end) {
+                return node;
+            }
+            int mid = start + (end - start) / 2;
+            if (i <= mid) {
+                push(2 * node + 1, mid + 1, end);
+                node = 2 * node;
+                end = mid;
+            } else {
+                push(2 * node, start, mid);
+                node = 2 * node + 1;
+                start = mid + 1;
+            }
+        }
+    }
+
+    // Helper function to recompute the ancestors of a leaf, bottom-up
+    void pull_path(int leaf) {
+        for (int node = leaf >> 1; node >= ROOT_NODE; node >>= 1) {
+            pull(node);
+        }
+    }
+
+    // Recursive function for maxRight
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    // l: left end of the search
+    // pred: monotone predicate on aggregates of arr[l...]
+    // acc: aggregate of arr[l...start-1], extended while pred holds
+    // Returns the first index in [start, end] at which pred fails, or -1 if
+    // it holds up to end. Descends into at most one child whose range
+    // starts at or after l and where pred fails, so O(log N) nodes are visited.
+    template <class Pred>
+    int max_right_recursive(int node, int start, int end, int l, Pred& pred, value_type& acc) {
+        count_visit(node);
+        if (end < l) {
+            return -1;
+        }
+        push(node, start, end);
+
+        // Case 1: [start, end] lies inside the search. Take it whole if pred allows.
+        if (l <= start) {
+            value_type combined = Monoid::combine(acc, nodes.value(layout.index(node)));
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (start == end) {
+                return start;
+            }
+        }
+
+        // Case 2: pred fails inside, or the search starts inside. Search the children.
+        count_split();
+        int mid = start + (end - start) / 2;
+        int found = max_right_recursive(2 * node, start, mid, l, pred, acc);
+        if (found != -1) {
+            return found;
+        }
+        return max_right_recursive(2 * node + 1, mid + 1, end, l, pred, acc);
+    }
+
+    // Helper function to describe this tree in a file header
+    // Fills in everything except the checksums.
+    TreeFileHeader file_header() const {
+        TreeFileHeader header = {};
+        memcpy(header.magic, "SEGTREE", 8);
+        header.version = TREE_FILE_VERSION;
+        header.header_bytes = sizeof(TreeFileHeader);
+        header.monoid = typeHash<Monoid>();
+        header.action = typeHash<Action>();
+        header.layout = typeHash<Layout>();
+        header.value_type = typeHash<value_type>();
+        header.tag_type = typeHash<tag_type>();
+        header.value_size = sizeof(value_type);
+        header.tag_size = sizeof(tag_type);
+        header.n = n;
+        header.slots = n == 0 ? 0 : layout.size();
+        header.values_offset = TREE_FILE_ALIGN;
+        size_t values_end = header.values_offset + header.slots * sizeof(value_type);
+        header.tags_offset = (values_end + TREE_FILE_ALIGN - 1) / TREE_FILE_ALIGN * TREE_FILE_ALIGN;
+        header.file_bytes = header.tags_offset + header.slots * sizeof(tag_type);
+        return header;
+    }
+
+    // Helper function to checksum a header, skipping its own checksum field
+    static uint64_t header_checksum(TreeFileHeader header) {
+        header.header_checksum = 0;
+        Checksum64 sum;
+        sum.update(&header, sizeof(header));
+        return sum.digest();
+    }
+
+    // Helper function to write 'count' slots of one array to a file
+    // get(slot): the element stored in a slot
+    // sum: checksum of the bytes written
+    // Returns false on a write error.
+    template <class T, class Get>
+    static bool write_slots(FILE* out, size_t count, Get get, Checksum64& sum) {
+        const size_t CHUNK = 1 << 16; // Elements per fwrite; keeps every update() a multiple of 8 bytes
+        vector<T> buffer;
+        buffer.reserve(min(count, CHUNK));
+        for (size_t first = 0; first < count; first += CHUNK) {
+            buffer.clear();
+            for (size_t slot = first; slot < min(count, first + CHUNK); ++slot) {
+                buffer.push_back(get(slot));
+            }
+            sum.update(buffer.data(), buffer.size() * sizeof(T));
+            if (fwrite(buffer.data(), sizeof(T), buffer.size(), out) != buffer.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    // Constructor
+    // arr: initial array, may hold a narrower type than value_type
+    //      (e.g. int for int64 sums)
+    // Time Complexity: O(N)
+    // Space Complexity: O(N) for tree and lazy arrays.
+    template <class E>
+    SegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        if (n == 0) return;
+        layout.init(n);
+        nodes.resize(layout.size(), Action::identity()); // No pending update anywhere
+        build_recursive(arr, ROOT_NODE, 0, n - 1);
+    }
+
+    // Parallel constructor
+    // arr: initial array, as above
+    // threads: number of threads to build with (0 = hardware concurrency).
+    //          Clamped to the hardware concurrency and to N.
+    //          The top levels of the tree are split into subtrees that are
+    //          built independently, so disjoint leaves and internal nodes
+    //          are filled in parallel and the rest is reduced bottom-up.
+    // Time Complexity: O(N / threads + log threads)
+    template <class E>
+    SegmentTree(const vector<E>& arr, unsigned threads) {
+        n = arr.size();
+        if (n == 0) return;
+        layout.init(n);
+        nodes.resize(layout.size(), Action::identity()); // No pending update anywhere
+        unsigned cores = max(1u, thread::hardware_concurrency());
+        if (threads == 0 || threads > cores) {
+            threads = cores;
+        }
+        threads = min(threads, (unsigned)n);
+        int spawn = 0;
+        while ((1u << spawn) < threads) {
+            ++spawn;
+        }
+        build_parallel(arr, ROOT_NODE, 0, n - 1, spawn);
+    }
+
+    // File constructor
+    // path: file written by save() from a tree with the same Monoid, Action,
+    //       Layout and value types (any Storage)
+    // mode: MapMode::ReadOnly or MapMode::CopyOnWrite, see MapMode
+    // verify: also check the checksums of both arrays, which reads the whole file
+    // Only available with MappedStorage. Throws runtime_error if the file
+    // cannot be mapped or was not written by a tree of this type.
+    // A ReadOnly tree answers the const methods (const queryRange, pointGet);
+    // the methods that write nodes (updateRange, applyBatch, queryBatch,
+    // non-const queryRange, pointAdd, pointSet, maxRight) throw runtime_error.
+    // Time Complexity: O(1) (O(N) with verify). Pages are read on first use.
+    SegmentTree(const string& path, MapMode mode = MapMode::ReadOnly, bool verify = false) {
+        auto fail = [&](const string& reason) { throw runtime_error(path + ": " + reason); };
+        nodes.map(path, mode);
+        read_only = mode == MapMode::ReadOnly;
+        TreeFileHeader header;
+        memcpy(&header, nodes.base, sizeof(header));
+        if (memcmp(header.magic, "SEGTREE", 8) != 0) fail("not a segment tree file");
+        if (header.version != TREE_FILE_VERSION) fail("unsupported format version " + to_string(header.version));
+        if (header.header_bytes != sizeof(TreeFileHeader) || header.header_checksum != header_checksum(header)) {
+            fail("corrupt header");
+        }
+        if (header.n < 0 || header.n > INT_MAX) fail("corrupt header");
+
+        n = header.n;
+        if (n > 0) {
+            layout.init(n);
+        }
+        TreeFileHeader expected = file_header();
+        if (header.monoid != expected.monoid || header.action != expected.action ||
+            header.value_type != expected.value_type || header.tag_type != expected.tag_type ||
+            header.value_size != expected.value_size || header.tag_size != expected.tag_size) {
+            fail("written by a tree with different policies or value types");
+        }
+        if (header.layout != expected.layout || header.slots != expected.slots) {
+            fail("written with a different layout");
+        }
+        if (header.values_offset != expected.values_offset || header.tags_offset != expected.tags_offset ||
+            header.file_bytes != expected.file_bytes || nodes.length != expected.file_bytes) {
+            fail("truncated or corrupt file");
+        }
+        nodes.attach(header.values_offset, header.tags_offset);
+
+        if (verify) {
+            Checksum64 values_sum, tags_sum;
+            values_sum.update(nodes.base + header.values_offset, header.slots * sizeof(value_type));
+            tags_sum.update(nodes.base + header.tags_offset, header.slots * sizeof(tag_type));
+            if (values_sum.digest() != header.values_checksum || tags_sum.digest() != header.tags_checksum) {
+                fail("checksum mismatch");
+            }
+        }
+    }
+
+    // Public method to save the tree to a file
+    // Writes the node arrays as they are, pending tags included (nothing is
+    // pushed), in the on-disk format described above. Works with any Storage;
+    // the file can be opened by the file constructor of a MappedStorage tree.
+    // Throws runtime_error if the file cannot be written.
+    // Time complexity: O(N)
+    void save(const string& path) const {
+        TreeFileHeader header = file_header();
+        FILE* out = fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            throw runtime_error(path + ": cannot create file");
+        }
+        vector<char> block(TREE_FILE_ALIGN, 0);
+        Checksum64 values_sum, tags_sum;
+        bool ok = fwrite(block.data(), 1, block.size(), out) == block.size(); // Header, filled in last
+        ok = ok && write_slots<value_type>(out, header.slots,
+                                           [&](size_t slot) { return nodes.value(slot); }, values_sum);
+        size_t padding = header.tags_offset - header.values_offset - header.slots * sizeof(value_type);
+        ok = ok && fwrite(block.data(), 1, padding, out) == padding;
+        ok = ok && write_slots<tag_type>(out, header.slots,
+                                         [&](size_t slot) { return nodes.tag(slot); }, tags_sum);
+
+        header.values_checksum = values_sum.digest();
+        header.tags_checksum = tags_sum.digest();
+        header.header_checksum = header_checksum(header);
+        memcpy(block.data(), &header, sizeof(header));
+        ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(block.data(), 1, block.size(), out) == block.size();
+        ok = fclose(out) == 0 && ok;
+        if (!ok) {
+            throw runtime_error(path + ": cannot write file");
+        }
+    }
+
+    // Public method for range update
+    // Applies 'val' to all elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    void updateRange(int l, int r, const tag_type& val) {
+        check_writable("updateRange");
+        StatsScope scope(*this);
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return;
+        }
+        update_recursive(ROOT_NODE, 0, n - 1, l, r, val);
+    }
+
+    // Public method for batched range updates
+    // Applies every update in 'updates', in order, in one traversal: each
+    // node touched by several updates is pushed and recomputed only once.
+    // Updates with invalid ranges are skipped, as in updateRange.
+    // With a commutative Action the updates are sorted by left end and split
+    // between children in place, and on a 10^6-element tree this beats an
+    // updateRange loop at every batch size (about 2x from 10^4 updates on).
+    // Otherwise batch order must be kept, the children's lists are copies,
+    // and it runs about as fast as the loop.
+    // Time complexity: O(K log N) for K updates, like K updateRange calls, but
+    // shared ancestors are visited once instead of K times.
+    void applyBatch(span<const Update> updates) {
+        check_writable("applyBatch");
+        StatsScope scope(*this);
+        vector<BatchEntry>& entries = batch_entries;
+        vector<tag_type>& tags = batch_tags;
+        entries.clear();
+        tags.clear();
+        for (const Update& u : updates) {
+            if (!(n == 0 || u.l < 0 || u.r >= n || u.l > u.r)) {
+                entries.push_back({u.l, u.r, (int)tags.size()});
+                tags.push_back(u.val);
+            }
+        }
+        if (entries.empty()) {
+            return;
+        }
+        if constexpr (isCommutative<Action>()) {
+            // Order does not matter; in left-end order the top-level splits find
+            // their lists already partitioned
+            sort(entries.begin(), entries.end(), [](const BatchEntry& a, const BatchEntry& b) { return a.l < b.l; });
+            batch_unordered_recursive(ROOT_NODE, 0, n - 1, entries, tags, 0, entries.size());
+        } else {
+            batch_recursive(ROOT_NODE, 0, n - 1, entries, tags, 0, entries.size());
+        }
+    }
+
+    // Public method for batched range queries
+    // Stores the aggregate of arr[ranges[i].first...ranges[i].second] in
+    // results[i] (identity for invalid ranges), exactly as queryRange would,
+    // while visiting each node at most once for the whole batch. The queries
+    // are sorted by left end and split between children in place, with both
+    // children prefetched while their lists are partitioned (this measured
+    // neutral on a 10^6-element tree, whose upper levels stay cached).
+    // results must have at least ranges.size() elements.
+    // Time complexity: O(K log K + K log N) for K queries. Only pays off for
+    // large batches: on a 10^6-element tree it is about as fast as a
+    // queryRange loop up to a few thousand random queries, and about a third
+    // faster from 10^5 queries on, where the shared upper levels dominate.
+    void queryBatch(span<const pair<int, int>> ranges, span<value_type> results) {
+        check_writable("queryBatch");
+        StatsScope scope(*this);
+        assert(results.size() >= ranges.size());
+        vector<BatchEntry>& entries = batch_entries;
+        entries.clear();
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            results[i] = Monoid::identity();
+            int l = ranges[i].first, r = ranges[i].second;
+            if (!(n == 0 || l < 0 || r >= n || l > r)) {
+                entries.push_back({l, r, (int)i});
+            }
+        }
+        if (!entries.empty()) {
+            // In left-end order, the top-level splits find their lists already partitioned
+            sort(entries.begin(), entries.end(), [](const BatchEntry& a, const BatchEntry& b) { return a.l < b.l; });
+            query_batch_recursive(ROOT_NODE, 0, n - 1, entries, results, 0, entries.size());
+        }
+    }
+
+    // Public method for range assignment
+    // Sets all elements in arr[l...r] to 'val' in a single O(log N) pass.
+    // Only available with an assigning action such as RangeAssignAddSum.
+    template <class V>
+    void assignRange(int l, int r, const V& val) {
+        updateRange(l, r, Action::assign(val));
+    }
+
+    // Public method for range query
+    // Returns the aggregate of elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    value_type queryRange(int l, int r) {
+        check_writable("queryRange");
+        StatsScope scope(*this);
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return Monoid::identity();
+        }
+        return query_recursive(ROOT_NODE, 0, n - 1, l, r);
+    }
+
+    // Public method for read-only range query
+    // Same result as queryRange, callable on a const SegmentTree. Pending
+    // tags are accumulated on the way down instead of pushed, so the query
+    // never writes to the tree and leaves its cache lines clean.
+    // Time complexity: O(log N) where N is the size of the original array.
+    value_type queryRange(int l, int r) const {
+        StatsScope scope(*this);
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return Monoid::identity();
+        }
+        return query_const_recursive(ROOT_NODE, 0, n - 1, l, r, Action::identity());
+    }
+
+    // Public methods for single elements
+    // pointAdd(i, val): same as updateRange(i, i, val)
+    // pointSet(i, x):   sets arr[i] to the element x; its leaf is built as the
+    //                   constructor builds it (makeLeaf<Monoid>(x, i))
+    // pointGet(i):      same as queryRange(i, i), and writes nothing
+    // Each walks the one root-to-leaf path of arr[i] in a loop instead of
+    // recursing over ranges: pointAdd and pointSet push the path down and
+    // pull it back up, pointGet composes the pending tags on the way down.
+    // Out-of-range indices are ignored (pointGet returns the identity).
+    // Time complexity: O(log N)
+    void pointAdd(int i, const tag_type& val) {
+        check_writable("pointAdd");
+        StatsScope scope(*this);
+        if (i < 0 || i >= n) {
+            return;
+        }
+        int leaf = push_path(i);
+        size_t slot = layout.index(leaf);
+        nodes.value(slot) = Action::apply(nodes.value(slot), val, 1);
+        pull_path(leaf);
+    }
+
+    template <class E>
+    void pointSet(int i, const E& x) {
+        check_writable("pointSet");
+        StatsScope scope(*this);
+        if (i < 0 || i >= n) {
+            return;
+        }
+        int leaf = push_path(i);
+        nodes.value(layout.index(leaf)) = makeLeaf<Monoid>(x, i);
+        pull_path(leaf);
+    }
+
+    value_type pointGet(int i) const {
+        StatsScope scope(*this);
+        if (i < 0 || i >= n) {
+            return Monoid::identity();
+        }
+        int node = ROOT_NODE, start = 0, end = n - 1;
+        tag_type pending = Action::identity(); // Ancestors' tags, newest first
+        while (true) {
+            count_visit(node);
+            size_t self = layout.index(node);
+            pending = Action::compose(pending, nodes.tag(self));
+            if (start == end) {
+                return Action::apply(nodes.value(self), pending, 1);
+            }
+            int mid = start + (end - start) / 2;
+            if (i <= mid) {
+                node = 2 * node;
+                end = mid;
+            } else {
+                node = 2 * node + 1;
+                start = mid + 1;
+            }
+        }
+    }
+
+    // Public method for searching to the right
+    // Returns the largest r (l - 1 <= r < n) such that pred holds on the
+    // aggregate of arr[l...r], or l - 1 if pred fails on arr[l] alone.
+    // pred must hold on Monoid::identity() and be monotone: once it fails
+    // for arr[l...r], it fails for every longer range. Pending updates are
+    // pushed on the way down, as in queryRange.
+    // l: left end of the search, 0 <= l <= n
+    // Time complexity: O(log N), instead of O(log^2 N) for a binary search
+    // over queryRange.
+    template <class Pred>
+    int maxRight(int l, Pred pred) {
+        check_writable("maxRight");
+        StatsScope scope(*this);
+        assert(0 <= l && l <= n);
+        assert(pred(Monoid::identity()));
+        if (l == n) {
+            return n - 1;
+        }
+        value_type acc = Monoid::identity();
+        int found = max_right_recursive(ROOT_NODE, 0, n - 1, l, pred, acc);
+        return found == -1 ? n - 1 : found - 1;
+    }
+
+    // Public method for prefix search
+    // Returns the smallest i such that the aggregate of arr[0...i] >= x, or n
+    // if there is none. For sums this needs non-negative elements, so that
+    // prefix sums only grow (weighted sampling, allocation); max works as is.
+    // Time complexity: O(log N)
+    int lowerBoundPrefix(const value_type& x) {
+        if (!(Monoid::identity() < x)) {
+            return 0; // The empty prefix already reaches x
+        }
+        return maxRight(0, [&](const value_type& v) { return v < x; }) + 1;
+    }
+
+    // Public methods for the work counters (see SegmentTreeStats)
+    // lastStats: counters of the most recent updateRange, queryRange,
+    //            applyBatch, queryBatch, pointAdd, pointSet, pointGet or
+    //            maxRight call (lowerBoundPrefix counts as its maxRight)
+    // totalStats: counters summed over all calls since construction or resetStats
+    // Both are all zero unless compiled with -DSEGMENT_TREE_STATS.
+    SegmentTreeStats lastStats() const {
+#ifdef SEGMENT_TREE_STATS
+        return op_stats;
+#else
+        return SegmentTreeStats();
+#endif
+    }
+
+    SegmentTreeStats totalStats() const {
+#ifdef SEGMENT_TREE_STATS
+        return total_stats;
+#else
+        return SegmentTreeStats();
+#endif
+    }
+
+    void resetStats() {
+#ifdef SEGMENT_TREE_STATS
+        op_stats = total_stats = SegmentTreeStats();
+#endif
+    }
+};
+
+// Non-recursive lazy segment tree over a power-of-two number of leaves.
+// Node 1 is the root, node i has children 2*i and 2*i+1, and the leaves
+// live at [size, 2*size). Updates and queries walk the two leaf-to-root
+// paths of the range boundaries instead of recursing from the root.
+template <class Monoid = SumMonoid<int>, class Action = RangeAddSum<int>>
+class IterativeSegmentTree {
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+
+private:
+    vector<value_type> tree; // Stores the aggregate of the range for each node
+    vector<tag_type> lazy;   // Pending update for each internal node (leaves need none)
+    int n;            // Size of the original array (elements are 0-indexed)
+    size_t size;      // Number of leaves: n rounded up to a power of two (up to 2^31)
+    int log;          // size == 1 << log
+    // Node indices reach 2 * size, past INT_MAX once n > 2^29, so they are size_t
+
+    // Applies 'val' to every element covered by node
+    // len: number of leaves below node
+    void apply(size_t node, const tag_type& val, long long len) {
+        tree[node] = Action::apply(tree[node], val, len);
+        if (node < size) {
+            lazy[node] = Action::compose(val, lazy[node]);
+        }
+    }
+
+    // Pushes the pending update of node down to its children
+    // len: number of leaves below node
+    void push(size_t node, long long len) {
+        if (!(lazy[node] == Action::identity())) {
+            apply(2 * node, lazy[node], len / 2);
+            apply(2 * node + 1, lazy[node], len / 2);
+            lazy[node] = Action::identity();
+        }
+    }
+
+    // Recomputes node from its children
+    void pull(size_t node) {
+        tree[node] = Monoid::combine(tree[2 * node], tree[2 * node + 1]);
+    }
+
+    // Pushes pending updates on the paths from the root to the boundaries
+    // of the half-open leaf range [l, r)
+    void push_boundaries(size_t l, size_t r) {
+        for (int i = log; i >= 1; --i) {
+            if (((l >> i) << i) != l) push(l >> i, 1LL << i);
+            if (((r >> i) << i) != r) push((r - 1) >> i, 1LL << i);
+        }
+    }
+
+public:
+    // Constructor
+    // arr: initial array, may hold a narrower type than value_type
+    //      (e.g. int for int64 sums)
+    // Time Complexity: O(N)
+    // Space Complexity: O(N) for tree and lazy arrays.
+    template <class E>
+    IterativeSegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        log = 0;
+        while (((size_t)1 << log) < (size_t)n) {
+            ++log;
+        }
+        size = (size_t)1 << log;
+        tree.assign(2 * size, Monoid::identity());
+        lazy.assign(size, Action::identity());
+        for (int i = 0; i < n; ++i) {
+            tree[size + i] = makeLeaf<Monoid>(arr[i], i);
+        }
+        for (size_t i = size - 1; i >= 1; --i) {
+            pull(i);
+        }
+    }
+
+    // Public method for range update
+    // Applies 'val' to all elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    void updateRange(int l, int r, const tag_type& val) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return;
+        }
+        size_t left = l + size, right = r + size + 1; // Half-open leaf range
+        push_boundaries(left, right);
+
+        size_t lo = left, hi = right;
+        for (long long len = 1; lo < hi; lo >>= 1, hi >>= 1, len <<= 1) {
+            if (lo & 1) apply(lo++, val, len);
+            if (hi & 1) apply(--hi, val, len);
+        }
+
+        for (int i = 1; i <= log; ++i) {
+            if (((left >> i) << i) != left) pull(left >> i);
+            if (((right >> i) << i) != right) pull((right - 1) >> i);
+        }
+    }
+
+    // Public method for range assignment
+    // Sets all elements in arr[l...r] to 'val' in a single O(log N) pass.
+    // Only available with an assigning action such as RangeAssignAddSum.
+    template <class V>
+    void assignRange(int l, int r, const V& val) {
+        updateRange(l, r, Action::assign(val));
+    }
+
+    // Public methods for single elements
+    // pointAdd(i, val): same as updateRange(i, i, val)
+    // pointSet(i, x):   sets arr[i] to the element x, built into a leaf as the
+    //                   constructor does (makeLeaf<Monoid>(x, i))
+    // pointGet(i):      same as queryRange(i, i), and writes nothing
+    // pointAdd and pointSet push the leaf's ancestors top-down and pull them
+    // bottom-up; pointGet applies the ancestors' tags to the leaf, nearest
+    // (oldest) first.
+    // Time complexity: O(log N)
+    void pointAdd(int i, const tag_type& val) {
+        if (i < 0 || i >= n) {
+            return;
+        }
+        size_t p = i + size;
+        for (int k = log; k >= 1; --k) push(p >> k, 1LL << k);
+        tree[p] = Action::apply(tree[p], val, 1);
+        for (int k = 1; k <= log; ++k) pull(p >> k);
+    }
+
+    template <class E>
+    void pointSet(int i, const E& x) {
+        if (i < 0 || i >= n) {
+            return;
+        }
+        size_t p = i + size;
+        for (int k = log; k >= 1; --k) push(p >> k, 1LL << k);
+        tree[p] = makeLeaf<Monoid>(x, i);
+        for (int k = 1; k <= log; ++k) pull(p >> k);
+    }
+
+    value_type pointGet(int i) const {
+        if (i < 0 || i >= n) {
+            return Monoid::identity();
+        }
+        size_t p = i + size;
+        value_type value = tree[p];
+        for (int k = 1; k <= log; ++k) {
+            value = Action::apply(value, lazy[p >> k], 1);
+        }
+        return value;
+    }
+
+    // Public method for range query
+    // Returns the aggregate of elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    value_type queryRange(int l, int r) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return Monoid::identity();
+        }
+        size_t lo = l + size, hi = r + size + 1; // Half-open leaf range
+        push_boundaries(lo, hi);
+
+        value_type left = Monoid::identity(), right = Monoid::identity();
+        for (; lo < hi; lo >>= 1, hi >>= 1) {
+            if (lo & 1) left = Monoid::combine(left, tree[lo++]);
+            if (hi & 1) right = Monoid::combine(tree[--hi], right);
+        }
+        return Monoid::combine(left, right);
+    }
+};
+
+
+// Bottom-up lazy segment tree sized exactly to the input: 2*N aggregates
+// and N pending tags, for any N (no rounding up to a power of two, no 4*N
+// heap). Leaves live at [n, 2n) and node i has children 2*i and 2*i+1.
+// When N is not a power of two a few internal nodes (e.g. the root) mix
+// leaves from different depths; they are never part of an answer and
+// never receive tags, so their contents are simply ignored.
+template <class Monoid = SumMonoid<int>, class Action = RangeAddSum<int>>
+class CompactSegmentTree {
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+
+private:
+    vector<value_type> tree; // Stores the aggregate of the range for each node
+    vector<tag_type> lazy;   // Pending update for each internal node [0, n)
+    int n;                   // Size of the original array (elements are 0-indexed)
+    int height;              // Number of levels above the leaves
+
+    // Applies 'val' to every element covered by node
+    // len: number of leaves below node
+    void apply(int node, const tag_type& val, int len) {
+        tree[node] = Action::apply(tree[node], val, len);
+        if (node < n) {
+            lazy[node] = Action::compose(val, lazy[node]);
+        }
+    }
+
+    // Recomputes the ancestors of the leaves [l, r) from their children
+    // (the node's own pending tag is already part of its aggregate)
+    void pull_range(int l, int r) {
+        int len = 2;
+        for (l += n, r += n - 1; l > 1; len <<= 1) {
+            l >>= 1;
+            r >>= 1;
+            for (int i = r; i >= l; --i) {
+                tree[i] = Monoid::combine(tree[2 * i], tree[2 * i + 1]);
+                if (!(lazy[i] == Action::identity())) {
+                    tree[i] = Action::apply(tree[i], lazy[i], len);
+                }
+            }
+        }
+    }
+
+    // Pushes pending updates from the top down to the leaves [l, r)
+    void push_range(int l, int r) {
+        int s = height, len = 1 << (height - 1);
+        for (l += n, r += n - 1; s > 0; --s, len >>= 1) {
+            for (int i = l >> s; i <= r >> s; ++i) {
+                if (!(lazy[i] == Action::identity())) {
+                    apply(2 * i, lazy[i], len);
+                    apply(2 * i + 1, lazy[i], len);
+                    lazy[i] = Action::identity();
+                }
+            }
+        }
+    }
+
+public:
+    // Constructor
+    // arr: initial array, may hold a narrower type than value_type
+    //      (e.g. int for int64 sums)
+    // Time Complexity: O(N)
+    // Space Complexity: 2*N aggregates and N tags.
+    template <class E>
+    CompactSegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        height = 0;
+        while (height < 31 && (n >> height) > 0) {
+            ++height;
+        }
+        tree.assign(2 * (size_t)n, Monoid::identity());
+        lazy.assign(n, Action::identity());
+        for (int i = 0; i < n; ++i) {
+            tree[n + i] = makeLeaf<Monoid>(arr[i], i);
+        }
+        for (int i = n - 1; i >= 1; --i) {
+            tree[i] = Monoid::combine(tree[2 * i], tree[2 * i + 1]);
+        }
+    }
+
+    // Public method for range update
+    // Applies 'val' to all elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    void updateRange(int l, int r, const tag_type& val) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return;
+        }
+        ++r; // Half-open from here on
+        push_range(l, l + 1);
+        push_range(r - 1, r);
+        int len = 1;
+        for (int lo = l + n, hi = r + n; lo < hi; lo >>= 1, hi >>= 1, len <<= 1) {
+            if (lo & 1) apply(lo++, val, len);
+            if (hi & 1) apply(--hi, val, len);
+        }
+        pull_range(l, l + 1);
+        pull_range(r - 1, r);
+    }
+
+    // Public method for range assignment
+    // Sets all elements in arr[l...r] to 'val' in a single O(log N) pass.
+    // Only available with an assigning action such as RangeAssignAddSum.
+    template <class V>
+    void assignRange(int l, int r, const V& val) {
+        updateRange(l, r, Action::assign(val));
+    }
+
+    // Public method for range query
+    // Returns the aggregate of elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    value_type queryRange(int l, int r) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return Monoid::identity();
+        }
+        ++r; // Half-open from here on
+        push_range(l, l + 1);
+        push_range(r - 1, r);
+        value_type left = Monoid::identity(), right = Monoid::identity();
+        for (l += n, r += n; l < r; l >>= 1, r >>= 1) {
+            if (l & 1) left = Monoid::combine(left, tree[l++]);
+            if (r & 1) right = Monoid::combine(tree[--r], right);
+        }
+        return Monoid::combine(left, right);
+    }
+};
+
+// Segment tree whose leaves are blocks of BLOCK contiguous elements
+// instead of single elements. The tree (4 * N / BLOCK nodes) only indexes
+// blocks; the elements themselves live in one flat array. A range that
+// covers a whole block is handled by the tree as usual and the block keeps
+// the pending tag for its elements in block_tags. Only the (at most two)
+// partially covered blocks of a range are touched element by element. Every
+// such loop, in queries and updates alike, runs over the whole block exactly
+// BLOCK times and masks the elements outside the range (to the identity when
+// scanning, unchanged when updating). At -O2 GCC vectorizes these loops for
+// 32-bit elements (int sums, min, max); 64-bit elements need 64-bit vector
+// compares, e.g. -march=x86-64-v3. elems is padded to whole blocks for this;
+// the padding is always masked out.
+// Compared with SegmentTree this cuts the node count about BLOCK times and
+// removes the deepest log2(BLOCK) levels from every walk, at the cost of
+// scanning up to 2 * BLOCK elements per operation.
+template <class Monoid = SumMonoid<int>, class Action = RangeAddSum<int>, int BLOCK = 64>
+class BucketedSegmentTree {
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+
+private:
+    vector<value_type> elems;     // Elements; block b is elems[b * BLOCK, (b + 1) * BLOCK),
+                                  // the last block padded to BLOCK elements
+    vector<tag_type> block_tags;  // Pending update of each block's elements
+    vector<value_type> tree;      // Aggregate of the elements under each node
+    vector<tag_type> lazy;        // Pending update of each node
+    int n = 0;                    // Size of the original array (elements are 0-indexed)
+    int blocks = 0;               // Number of blocks, the last one may be short
+    const int ROOT_NODE = 1;
+
+    // First and last element of blocks [first_block, last_block]
+    int elem_start(int first_block) const { return first_block * BLOCK; }
+    int elem_end(int last_block) const { return min(n, (last_block + 1) * BLOCK) - 1; }
+
+    // Helper functions for elems[from...to], which must lie in one block:
+    // scan returns their aggregate (without the block's tag), apply_range
+    // applies 'tag' to each of them. Both loop over the whole block with the
+    // compile-time trip count BLOCK, which GCC's -O2 vectorizer requires,
+    // and mask the elements outside [from, to].
+    value_type scan(int from, int to) const {
+        int first = from / BLOCK * BLOCK;
+        const value_type* block = elems.data() + first;
+        int lo = from - first, hi = to - first;
+        // Masked copy first, then a plain reduction: folded into one loop, GCC
+        // turns the mask back into a branch around the load and gives up
+        const value_type none = Monoid::identity();
+        value_type masked[BLOCK];
+        for (int i = 0; i < BLOCK; ++i) {
+            value_type x = block[i];
+            masked[i] = (i >= lo) & (i <= hi) ? x : none;
+        }
+        value_type acc = none;
+        for (int i = 0; i < BLOCK; ++i) {
+            acc = Monoid::combine(acc, masked[i]);
+        }
+        return acc;
+    }
+
+    void apply_range(int from, int to, tag_type tag) {
+        int first = from / BLOCK * BLOCK;
+        value_type* block = elems.data() + first;
+        int lo = from - first, hi = to - first;
+        for (int i = 0; i < BLOCK; ++i) {
+            block[i] = (i >= lo) & (i <= hi) ? Action::apply(block[i], tag, 1) : block[i];
+        }
+    }
+
+    // Helper function to push lazy updates down to children
+    // (to block_tags at the leaves)
+    // node: current segment tree node index
+    // start, end: blocks covered by this node
+    void push(int node, int start, int end) {
+        if (!(lazy[node] == Action::identity())) {
+            tree[node] = Action::apply(tree[node], lazy[node], elem_end(end) - elem_start(start) + 1);
+            if (start != end) {
+                lazy[2 * node] = Action::compose(lazy[node], lazy[2 * node]);
+                lazy[2 * node + 1] = Action::compose(lazy[node], lazy[2 * node + 1]);
+            } else {
+                block_tags[start] = Action::compose(lazy[node], block_tags[start]);
+            }
+            lazy[node] = Action::identity();
+        }
+    }
+
+    // Recursive function to build the tree over the block aggregates
+    void build_recursive(int node, int start, int end) {
+        if (start == end) {
+            tree[node] = scan(elem_start(start), elem_end(end));
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        build_recursive(2 * node, start, mid);
+        build_recursive(2 * node + 1, mid + 1, end);
+        tree[node] = Monoid::combine(tree[2 * node], tree[2 * node + 1]);
+    }
+
+    // Recursive function for range updates
+    // node: current segment tree node index
+    // start, end: blocks covered by this node
+    // l, r: update range (0-indexed elements)
+    // val: update to apply
+    void update_recursive(int node, int start, int end, int l, int r, const tag_type& val) {
+        push(node, start, end);
+        int first = elem_start(start), last = elem_end(end);
+
+        // Case 1: The blocks are completely outside the update range
+        if (first > r || last < l) {
+            return;
+        }
+
+        // Case 2: The blocks are completely inside the update range
+        if (l <= first && last <= r) {
+            tree[node] = Action::apply(tree[node], val, last - first + 1);
+            if (start != end) {
+                lazy[2 * node] = Action::compose(val, lazy[2 * node]);
+                lazy[2 * node + 1] = Action::compose(val, lazy[2 * node + 1]);
+            } else {
+                block_tags[start] = Action::compose(val, block_tags[start]);
+            }
+            return;
+        }
+
+        // Case 3: One partially covered block. Apply its pending tag to its
+        // elements, update the covered ones and rescan it.
+        if (start == end) {
+            tag_type pending = block_tags[start];
+            if (!(pending == Action::identity())) {
+                apply_range(first, last, pending);
+                block_tags[start] = Action::identity();
+            }
+            apply_range(max(l, first), min(r, last), val);
+            tree[node] = scan(first, last);
+            return;
+        }
+
+        // Case 4: Partial overlap of several blocks. Recurse on children.
+        int mid = start + (end - start) / 2;
+        update_recursive(2 * node, start, mid, l, r, val);
+        update_recursive(2 * node + 1, mid + 1, end, l, r, val);
+        tree[node] = Monoid::combine(tree[2 * node], tree[2 * node + 1]);
+    }
+
+    // Recursive function for range queries
+    // node: current segment tree node index
+    // start, end: blocks covered by this node
+    // l, r: query range (0-indexed elements)
+    value_type query_recursive(int node, int start, int end, int l, int r) {
+        int first = elem_start(start), last = elem_end(end);
+
+        // Case 1: The blocks are completely outside the query range
+        if (first > r || last < l) {
+            return Monoid::identity();
+        }
+
+        push(node, start, end);
+
+        // Case 2: The blocks are completely inside the query range
+        if (l <= first && last <= r) {
+            return tree[node];
+        }
+
+        // Case 3: One partially covered block. Scan the covered elements and
+        // apply the block's pending tag to their aggregate.
+        if (start == end) {
+            int from = max(l, first), to = min(r, last);
+            return Action::apply(scan(from, to), block_tags[start], to - from + 1);
+        }
+
+        // Case 4: Partial overlap of several blocks. Recurse on children and combine results.
+        int mid = start + (end - start) / 2;
+        value_type p1 = query_recursive(2 * node, start, mid, l, r);
+        value_type p2 = query_recursive(2 * node + 1, mid + 1, end, l, r);
+        return Monoid::combine(p1, p2);
+    }
+
+public:
+    // Constructor
+    // arr: initial array
+    // Time Complexity: O(N)
+    // Space Complexity: O(N) for the elements plus O(N / BLOCK) for the tree.
+    template <class E>
+    BucketedSegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        if (n == 0) return;
+        blocks = (n + BLOCK - 1) / BLOCK;
+        elems.assign((size_t)blocks * BLOCK, Monoid::identity());
+        for (int i = 0; i < n; ++i) {
+            elems[i] = makeLeaf<Monoid>(arr[i], i);
+        }
+        block_tags.assign(blocks, Action::identity());
+        tree.resize(4 * (size_t)blocks);
+        lazy.assign(4 * (size_t)blocks, Action::identity());
+        build_recursive(ROOT_NODE, 0, blocks - 1);
+    }
+
+    // Public method for range update
+    // Applies 'val' to all elements in arr[l...r]
+    // Time complexity: O(log(N / BLOCK) + BLOCK)
+    void updateRange(int l, int r, const tag_type& val) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return;
+        }
+        update_recursive(ROOT_NODE, 0, blocks - 1, l, r, val);
+    }
+
+    // Public method for range assignment
+    // Sets all elements in arr[l...r] to 'val'; only with an assigning action.
+    template <class V>
+    void assignRange(int l, int r, const V& val) {
+        updateRange(l, r, Action::assign(val));
+    }
+
+    // Public method for range query
+    // Returns the aggregate of elements in arr[l...r]
+    // Time complexity: O(log(N / BLOCK) + BLOCK)
+    value_type queryRange(int l, int r) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return Monoid::identity();
+        }
+        return query_recursive(ROOT_NODE, 0, blocks - 1, l, r);
+    }
+};
+
+// Segment Tree Beats (Ji's driver): range chmin, range chmax and range add
+// with range sum/max/min queries, all amortized O(log^2 N).
+// Every node keeps the largest value, the strict second largest and how
+// many elements hold the largest (and the same for the smallest). A chmin
+// with max2 < val < max1 only lowers the max1 elements, so it is applied
+// to the node as a tag without visiting the children; otherwise the
+// update recurses.
+template <class T = long long>
+class SegmentTreeBeats {
+private:
+    struct Node {
+        T sum;
+        T max1, max2; // Largest value and strict second largest
+        T min1, min2; // Smallest value and strict second smallest
+        int max_cnt, min_cnt;
+        T add;        // Pending addition for the children
+    };
+
+    static constexpr T NEG_INF = numeric_limits<T>::lowest();
+    static constexpr T POS_INF = numeric_limits<T>::max();
+
+    vector<Node> tree;
+    int n;                // Size of the original array (elements are 0-indexed)
+    const int ROOT_NODE = 1; // Root of the segment tree is at index 1
+
+    // Adds 'val' to every element of node, which covers len elements
+    void apply_add(int node, T val, int len) {
+        Node& t = tree[node];
+        t.sum += val * len;
+        t.max1 += val;
+        if (t.max2 != NEG_INF) t.max2 += val;
+        t.min1 += val;
+        if (t.min2 != POS_INF) t.min2 += val;
+        t.add += val;
+    }
+
+    // Lowers the largest elements of node to 'val' (requires max2 < val < max1)
+    void apply_chmin(int node, T val) {
+        Node& t = tree[node];
+        t.sum -= (t.max1 - val) * t.max_cnt;
+        if (t.min1 == t.max1) {
+            t.min1 = val;
+        } else if (t.min2 == t.max1) {
+            t.min2 = val;
+        }
+        t.max1 = val;
+    }
+
+    // Raises the smallest elements of node to 'val' (requires min1 < val < min2)
+    void apply_chmax(int node, T val) {
+        Node& t = tree[node];
+        t.sum += (val - t.min1) * t.min_cnt;
+        if (t.max1 == t.min1) {
+            t.max1 = val;
+        } else if (t.max2 == t.min1) {
+            t.max2 = val;
+        }
+        t.min1 = val;
+    }
+
+    // Helper function to push lazy updates down to children
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    void push(int node, int start, int end) {
+        if (start == end) {
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        Node& t = tree[node];
+        if (t.add != 0) {
+            apply_add(2 * node, t.add, mid - start + 1);
+            apply_add(2 * node + 1, t.add, end - mid);
+            t.add = 0;
+        }
+        for (int child = 2 * node; child <= 2 * node + 1; ++child) {
+            if (tree[child].max1 > t.max1) apply_chmin(child, t.max1);
+            if (tree[child].min1 < t.min1) apply_chmax(child, t.min1);
+        }
+    }
+
+    // Helper function to recompute a node from its children
+    void pull(int node) {
+        Node& t = tree[node];
+        const Node& a = tree[2 * node];
+        const Node& b = tree[2 * node + 1];
+        t.sum = a.sum + b.sum;
+        if (a.max1 == b.max1) {
+            t.max1 = a.max1;
+            t.max2 = max(a.max2, b.max2);
+            t.max_cnt = a.max_cnt + b.max_cnt;
+        } else if (a.max1 > b.max1) {
+            t.max1 = a.max1;
+            t.max2 = max(a.max2, b.max1);
+            t.max_cnt = a.max_cnt;
+        } else {
+            t.max1 = b.max1;
+            t.max2 = max(a.max1, b.max2);
+            t.max_cnt = b.max_cnt;
+        }
+        if (a.min1 == b.min1) {
+            t.min1 = a.min1;
+            t.min2 = min(a.min2, b.min2);
+            t.min_cnt = a.min_cnt + b.min_cnt;
+        } else if (a.min1 < b.min1) {
+            t.min1 = a.min1;
+            t.min2 = min(a.min2, b.min1);
+            t.min_cnt = a.min_cnt;
+        } else {
+            t.min1 = b.min1;
+            t.min2 = min(a.min1, b.min2);
+            t.min_cnt = b.min_cnt;
+        }
+    }
+
+    // Recursive function to build the segment tree
+    // arr: initial array
+    // node: current segment tree node index
+    // start, end: range covered by this node (0-indexed based on original array)
+    template <class E>
+    void build_recursive(const vector<E>& arr, int node, int start, int end) {
+        tree[node].add = 0;
+        if (start == end) {
+            T v = T(arr[start]);
+            tree[node].sum = tree[node].max1 = tree[node].min1 = v;
+            tree[node].max2 = NEG_INF;
+            tree[node].min2 = POS_INF;
+            tree[node].max_cnt = tree[node].min_cnt = 1;
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        build_recursive(arr, 2 * node, start, mid);
+        build_recursive(arr, 2 * node + 1, mid + 1, end);
+        pull(node);
+    }
+
+    // Recursive function for range add
+    // node: current segment tree node index
+    // start, end: range covered by this node
+    // l, r: update range (0-indexed)
+    // val: value to add
+    void add_recursive(int node, int start, int end, int l, int r, T val) {
+        if (start > r || end < l) {
+            return;
+        }
+        if (l <= start && end <= r) {
+            apply_add(node, val, end - start + 1);
+            return;
+        }
+        push(node, start, end);
+        int mid = start + (end - start) / 2;
+        add_recursive(2 * node, start, mid, l, r, val);
+        add_recursive(2 * node + 1, mid + 1, end, l, r, val);
+        pull(node);
+    }
+
+    // Recursive function for range chmin: a[i] = min(a[i], val)
+    // Stops as soon as the node's maximum is already small enough, and
+    // tags the node when only its largest elements change.
+    void chmin_recursive(int node, int start, int end, int l, int r, T val) {
+        if (start > r || end < l || tree[node].max1 <= val) {
+            return;
+        }
+        if (l <= start && end <= r && tree[node].max2 < val) {
+            apply_chmin(node, val);
+            return;
+        }
+        push(node, start, end);
+        int mid = start + (end - start) / 2;
+        chmin_recursive(2 * node, start, mid, l, r, val);
+        chmin_recursive(2 * node + 1, mid + 1, end, l, r, val);
+        pull(node);
+    }
+
+    // Recursive function for range chmax: a[i] = max(a[i], val)
+    void chmax_recursive(int node, int start, int end, int l, int r, T val) {
+        if (start > r || end < l || tree[node].min1 >= val) {
+            return;
+        }
+        if (l <= start && end <= r && tree[node].min2 > val) {
+            apply_chmax(node, val);
+            return;
+        }
+        push(node, start, end);
+        int mid = start + (end - start) / 2;
+        chmax_recursive(2 * node, start, mid, l, r, val);
+        chmax_recursive(2 * node + 1, mid + 1, end, l, r, val);
+        pull(node);
+    }
+
+    // Recursive function for range queries
+    // Combines the fully covered nodes of [l, r] with 'visit'
+    template <class Visit>
+    void query_recursive(int node, int start, int end, int l, int r, Visit& visit) {
+        if (start > r || end < l) {
+            return;
+        }
+        if (l <= start && end <= r) {
+            visit(tree[node]);
+            return;
+        }
+        push(node, start, end);
+        int mid = start + (end - start) / 2;
+        query_recursive(2 * node, start, mid, l, r, visit);
+        query_recursive(2 * node + 1, mid + 1, end, l, r, visit);
+    }
+
+    bool invalid(int l, int r) const {
+        return n == 0 || l < 0 || r >= n || l > r;
+    }
+
+public:
+    // Constructor
+    // arr: initial array
+    // Time Complexity: O(N)
+    // Space Complexity: O(N) nodes.
+    template <class E>
+    SegmentTreeBeats(const vector<E>& arr) {
+        n = arr.size();
+        if (n == 0) return;
+        tree.resize(4 * n);
+        build_recursive(arr, ROOT_NODE, 0, n - 1);
+    }
+
+    // Adds 'val' to all elements in arr[l...r]
+    // Time complexity: O(log^2 N) amortized.
+    void updateRange(int l, int r, T val) {
+        if (invalid(l, r)) return;
+        add_recursive(ROOT_NODE, 0, n - 1, l, r, val);
+    }
+
+    // Sets arr[i] = min(arr[i], val) for all i in [l, r]
+    // Time complexity: O(log^2 N) amortized.
+    void chminRange(int l, int r, T val) {
+        if (invalid(l, r)) return;
+        chmin_recursive(ROOT_NODE, 0, n - 1, l, r, val);
+    }
+
+    // Sets arr[i] = max(arr[i], val) for all i in [l, r]
+    // Time complexity: O(log^2 N) amortized.
+    void chmaxRange(int l, int r, T val) {
+        if (invalid(l, r)) return;
+        chmax_recursive(ROOT_NODE, 0, n - 1, l, r, val);
+    }
+
+    // Returns sum of elements in arr[l...r]
+    T queryRange(int l, int r) {
+        T sum = 0;
+        if (invalid(l, r)) return sum;
+        auto visit = [&](const Node& t) { sum += t.sum; };
+        query_recursive(ROOT_NODE, 0, n - 1, l, r, visit);
+        return sum;
+    }
+
+    // Returns the maximum of arr[l...r] (lowest() for an invalid range)
+    T queryMax(int l, int r) {
+        T result = NEG_INF;
+        if (invalid(l, r)) return result;
+        auto visit = [&](const Node& t) { result = max(result, t.max1); };
+        query_recursive(ROOT_NODE, 0, n - 1, l, r, visit);
+        return result;
+    }
+
+    // Returns the minimum of arr[l...r] (max() for an invalid range)
+    T queryMin(int l, int r) {
+        T result = POS_INF;
+        if (invalid(l, r)) return result;
+        auto visit = [&](const Node& t) { result = min(result, t.min1); };
+        query_recursive(ROOT_NODE, 0, n - 1, l, r, visit);
+        return result;
+    }
+};
+
+// Wide segment tree ("S-tree") for sums with point updates. Every node has
+// B = 16 children and stores, for each child, the sum of the children before
+// it (an exclusive prefix sum), so a node is one cache line of 32-bit sums.
+// A prefix sum adds one entry per level, about log_16 N scalar loads and no
+// branches. A point update adds the value to the entries after the updated
+// child in each of those nodes, a fixed 16-lane masked add that the compiler
+// vectorizes (SSE2 by default; with -march=native a node of int is one
+// AVX-512 or two AVX2 adds).
+// Only sums (any T with + and -) and point updates; no lazy range updates.
+template <class T = int>
+class WideSegmentTree {
+private:
+    static constexpr int B = 16;     // Children per node
+    static constexpr int LOG_B = 4;
+    // Level h holds the nodes over indices k >> (LOG_B * h), laid out one
+    // after the other; entry offset[h] + (k >> (LOG_B * h)) is the sum of the
+    // siblings before k's ancestor on that level.
+    aligned_vector<T> tree;
+    vector<size_t> offset;
+    int n = 0;  // Size of the original array (elements are 0-indexed)
+
+    // Helper function for the sum of arr[0...k-1], 0 <= k <= n
+    T prefix_exclusive(int k) const {
+        T sum = T(0);
+        for (size_t h = 0; h < offset.size(); ++h) {
+            sum += tree[offset[h] + ((size_t)k >> (LOG_B * h))];
+        }
+        return sum;
+    }
+
+public:
+    // Constructor
+    // arr: initial array
+    // Time Complexity: O(N)
+    // Space Complexity: about N * 16/15 values, plus a line of padding per level.
+    template <class E>
+    WideSegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        // Index n is valid as well, so that prefix_exclusive(n) is the total
+        vector<T> totals(n + 1, T(0)); // Sums of the subtrees on the current level
+        for (int i = 0; i < n; ++i) {
+            totals[i] = T(arr[i]);
+        }
+        vector<vector<T>> levels;
+        while (true) {
+            size_t nodes = (totals.size() + B - 1) / B;
+            vector<T> level(nodes * B, T(0));
+            vector<T> parent_totals(nodes, T(0));
+            for (size_t i = 0; i < totals.size(); ++i) {
+                level[i] = parent_totals[i / B]; // Siblings before i
+                parent_totals[i / B] += totals[i];
+            }
+            levels.push_back(move(level));
+            if (nodes == 1) break;
+            totals = move(parent_totals);
+        }
+        size_t total_size = 0;
+        for (const vector<T>& level : levels) {
+            offset.push_back(total_size);
+            total_size += level.size();
+        }
+        tree.resize(total_size);
+        for (size_t h = 0; h < levels.size(); ++h) {
+            copy(levels[h].begin(), levels[h].end(), tree.begin() + offset[h]);
+        }
+    }
+
+    // Public method for point update
+    // Adds 'val' to arr[i]
+    // Time complexity: O(log_16 N) nodes, each one vector add
+    void pointAdd(int i, const T& val) {
+        if (i < 0 || i >= n) {
+            return;
+        }
+        T add = val; // A copy, so the compiler knows it does not alias the nodes
+        for (size_t h = 0; h < offset.size(); ++h) {
+            size_t k = (size_t)i >> (LOG_B * h);
+            T* node = &tree[offset[h] + (k & ~(size_t)(B - 1))];
+            int child = k & (B - 1);
+            for (int j = 0; j < B; ++j) {
+                node[j] += j > child ? add : T(0);
+            }
+        }
+    }
+
+    // Public method for range query
+    // Returns the sum of elements in arr[l...r]
+    // Time complexity: O(log_16 N)
+    T queryRange(int l, int r) const {
+        if (l < 0 || r >= n || l > r) {
+            return T(0);
+        }
+        return prefix_exclusive(r + 1) - prefix_exclusive(l);
+    }
+};
+
+// Segment tree shared by one writer thread and any number of reader
+// threads, with no locks. This is a sequence lock, not RCU: there is one
+// copy of the tree, which the writer updates in place as SegmentTree does,
+// bumping 'sequence' to an odd value while it works. Readers never write:
+// queryRange is const and, instead of pushing tags, composes the pending
+// tags met on the way down and applies them to the nodes it returns. A
+// reader that saw the sequence change retries, so a query always reflects
+// a whole number of updates.
+// Trade-offs of this design:
+// - Readers do not slow each other down, so they scale with the number of
+//   cores while updates are occasional.
+// - A reader retries after any update that overlapped it in time, even one
+//   on an unrelated range, and yields in a loop while an update runs.
+// - Under a continuous stream of updates readers can retry indefinitely
+//   (livelock); the writer is never delayed.
+// Publishing path-copied versions behind an atomic root (as
+// PersistentSegmentTree builds them) would let readers finish on the
+// version they started with, at the cost of O(log N) new nodes per update
+// and a way to reclaim the old ones once no reader holds them.
+// Nodes are atomics so that concurrent access is well defined, which limits
+// value_type and tag_type to lock-free types (e.g. int or long long sums).
+template <class Monoid = SumMonoid<int>, class Action = RangeAddSum<int>>
+class ConcurrentSegmentTree {
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+
+private:
+    static_assert(atomic<value_type>::is_always_lock_free && atomic<tag_type>::is_always_lock_free,
+                  "ConcurrentSegmentTree needs lock-free value and tag types");
+
+    unique_ptr<atomic<value_type>[]> tree; // Aggregate of each node, excluding its own tag
+    unique_ptr<atomic<tag_type>[]> lazy;   // Pending update of each node
+    int n;                // Size of the original array (elements are 0-indexed)
+    const int ROOT_NODE = 1; // Root of the segment tree is at index 1
+    alignas(64) atomic<unsigned long long> sequence{0}; // Odd while an update is in progress
+
+    value_type get_value(int node) const { return tree[node].load(memory_order_relaxed); }
+    tag_type get_tag(int node) const { return lazy[node].load(memory_order_relaxed); }
+    void set_value(int node, const value_type& v) { tree[node].store(v, memory_order_relaxed); }
+    void set_tag(int node, const tag_type& t) { lazy[node].store(t, memory_order_relaxed); }
+
+    // Helper function to push lazy updates down to children (writer only)
+    void push(int node, int start, int end) {
+        tag_type tag = get_tag(node);
+        if (!(tag == Action::identity())) {
+            set_value(node, Action::apply(get_value(node), tag, end - start + 1));
+            if (start != end) {
+                set_tag(2 * node, Action::compose(tag, get_tag(2 * node)));
+                set_tag(2 * node + 1, Action::compose(tag, get_tag(2 * node + 1)));
+            }
+            set_tag(node, Action::identity());
+        }
+    }
+
+    // Recursive function to build the segment tree
+    template <class E>
+    void build_recursive(const vector<E>& arr, int node, int start, int end) {
+        set_tag(node, Action::identity());
+        if (start == end) {
+            set_value(node, makeLeaf<Monoid>(arr[start], start));
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        build_recursive(arr, 2 * node, start, mid);
+        build_recursive(arr, 2 * node + 1, mid + 1, end);
+        set_value(node, Monoid::combine(get_value(2 * node), get_value(2 * node + 1)));
+    }
+
+    // Recursive function for range updates (writer only), as in SegmentTree
+    void update_recursive(int node, int start, int end, int l, int r, const tag_type& val) {
+        push(node, start, end);
+        if (start > end || start > r || end < l) {
+            return;
+        }
+        if (l <= start && end <= r) {
+            set_value(node, Action::apply(get_value(node), val, end - start + 1));
+            if (start != end) {
+                set_tag(2 * node, Action::compose(val, get_tag(2 * node)));
+                set_tag(2 * node + 1, Action::compose(val, get_tag(2 * node + 1)));
+            }
+            return;
+        }
+        int mid = start + (end - start) / 2;
+        update_recursive(2 * node, start, mid, l, r, val);
+        update_recursive(2 * node + 1, mid + 1, end, l, r, val);
+        set_value(node, Monoid::combine(get_value(2 * node), get_value(2 * node + 1)));
+    }
+
+    // Recursive function for read-only range queries
+    // pending: composition of the tags of all ancestors of node (newest first)
+    value_type query_recursive(int node, int start, int end, int l, int r, tag_type pending) const {
+        if (start > end || start > r || end < l) {
+            return Monoid::identity();
+        }
+        // Ancestors' tags are newer than the node's own one
+        pending = Action::compose(pending, get_tag(node));
+        if (l <= start && end <= r) {
+            return Action::apply(get_value(node), pending, end - start + 1);
+        }
+        int mid = start + (end - start) / 2;
+        value_type p1 = query_recursive(2 * node, start, mid, l, r, pending);
+        value_type p2 = query_recursive(2 * node + 1, mid + 1, end, l, r, pending);
+        return Monoid::combine(p1, p2);
+    }
+
+public:
+    // Constructor
+    // arr: initial array, may hold a narrower type than value_type
+    // Time Complexity: O(N)
+    // Space Complexity: O(N) for tree and lazy arrays.
+    template <class E>
+    ConcurrentSegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        if (n == 0) return;
+        tree.reset(new atomic<value_type>[4 * (size_t)n]);
+        lazy.reset(new atomic<tag_type>[4 * (size_t)n]);
+        build_recursive(arr, ROOT_NODE, 0, n - 1);
+    }
+
+    // Public method for range update. Must only be called by one thread at a time.
+    // Applies 'val' to all elements in arr[l...r]
+    // Time complexity: O(log N) where N is the size of the original array.
+    void updateRange(int l, int r, const tag_type& val) {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return;
+        }
+        unsigned long long seq = sequence.load(memory_order_relaxed);
+        sequence.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        update_recursive(ROOT_NODE, 0, n - 1, l, r, val);
+        sequence.store(seq + 2, memory_order_release);
+    }
+
+    // Public method for range query. Safe to call from any number of threads,
+    // concurrently with the writer.
+    // Returns the aggregate of elements in arr[l...r]
+    // Time complexity: O(log N) when no update is running; otherwise the
+    // query waits for the update and retries, without bound if updates never stop.
+    value_type queryRange(int l, int r) const {
+        if (n == 0 || l < 0 || r >= n || l > r) {
+            return Monoid::identity();
+        }
+        while (true) {
+            unsigned long long before = sequence.load(memory_order_acquire);
+            if (before & 1) {
+                this_thread::yield(); // Writer in progress
+                continue;
+            }
+            value_type result = query_recursive(ROOT_NODE, 0, n - 1, l, r, Action::identity());
+            atomic_thread_fence(memory_order_acquire);
+            if (sequence.load(memory_order_relaxed) == before) {
+                return result;
+            }
+        }
+    }
+};
+
+// Pool of tree nodes addressed by 32-bit index. Nodes live in fixed-size
+// chunks that never move, so growing the pool never copies existing nodes
+// (unlike a vector) and a node costs no per-allocation overhead.
+// Index 0 is reserved as "no node".
+template <class Node>
+class NodePool {
+private:
+    static constexpr int CHUNK_BITS = 16;
+    static constexpr int CHUNK_SIZE = 1 << CHUNK_BITS;
+    vector<unique_ptr<Node[]>> chunks;
+    int count = 1; // Slot 0 is the null node
+
+public:
+    NodePool() { chunks.emplace_back(new Node[CHUNK_SIZE]()); }
+
+    // Returns the index of a new node initialized to 'node'
+    int allocate(const Node& node) {
+        if ((count & (CHUNK_SIZE - 1)) == 0) {
+            chunks.emplace_back(new Node[CHUNK_SIZE]);
+        }
+        int index = count++;
+        (*this)[index] = node;
+        return index;
+    }
+
+    Node& operator[](int index) { return chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)]; }
+    const Node& operator[](int index) const { return chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)]; }
+
+    // Number of nodes handed out so far
+    size_t size() const { return count - 1; }
+    size_t memoryBytes() const { return chunks.size() * CHUNK_SIZE * sizeof(Node); }
+};
+
+// Persistent (versioned) segment tree. Every updateRange creates a new
+// version by copying only the O(log N) nodes on its paths; all other nodes
+// are shared with the previous version. Old versions stay queryable.
+// Tags are never pushed (a pushed tag would have to be copied into both
+// children of every shared node); they stay on the node they were put on
+// and queries compose them on the way down. A node's value already
+// includes its own tag, so tags must commute with each other (additions
+// do; assignments do not).
+template <class Monoid = SumMonoid<long long>, class Action = RangeAddSum<long long>>
+class PersistentSegmentTree {
+    static_assert(isCommutative<Action>(),
+                  "PersistentSegmentTree keeps tags on their nodes and needs an Action with commutative = true");
+
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+
+private:
+    struct Node {
+        value_type value; // Aggregate of the range, including this node's tag
+        tag_type tag;     // Update applied to the whole range, not yet in the children
+        int left, right;  // Children in the pool
+    };
+
+    NodePool<Node> pool;
+    vector<int> roots; // roots[v] is the root of version v
+    int n;             // Size of the original array (elements are 0-indexed)
+
+    // Recursive function to build version 0
+    template <class E>
+    int build_recursive(const vector<E>& arr, int start, int end) {
+        if (start == end) {
+            return pool.allocate({makeLeaf<Monoid>(arr[start], start), Action::identity(), 0, 0});
+        }
+        int mid = start + (end - start) / 2;
+        int left = build_recursive(arr, start, mid);
+        int right = build_recursive(arr, mid + 1, end);
+        return pool.allocate({Monoid::combine(pool[left].value, pool[right].value),
+                              Action::identity(), left, right});
+    }
+
+    // Recursive function for range updates with path copying
+    // Returns the copy of node that reflects the update.
+    int update_recursive(int node, int start, int end, int l, int r, const tag_type& val) {
+        Node copy = pool[node];
+        if (l <= start && end <= r) {
+            copy.value = Action::apply(copy.value, val, end - start + 1);
+            copy.tag = Action::compose(val, copy.tag);
+            return pool.allocate(copy);
+        }
+        int mid = start + (end - start) / 2;
+        if (l <= mid) copy.left = update_recursive(copy.left, start, mid, l, r, val);
+        if (r > mid) copy.right = update_recursive(copy.right, mid + 1, end, l, r, val);
+        copy.value = Action::apply(Monoid::combine(pool[copy.left].value, pool[copy.right].value),
+                                   copy.tag, end - start + 1);
+        return pool.allocate(copy);
+    }
+
+    // Recursive function for range queries
+    // pending: composition of the tags of all ancestors of node
+    value_type query_recursive(int node, int start, int end, int l, int r, tag_type pending) const {
+        const Node& t = pool[node];
+        if (l <= start && end <= r) {
+            return Action::apply(t.value, pending, end - start + 1);
+        }
+        pending = Action::compose(pending, t.tag);
+        int mid = start + (end - start) / 2;
+        if (r <= mid) return query_recursive(t.left, start, mid, l, r, pending);
+        if (l > mid) return query_recursive(t.right, mid + 1, end, l, r, pending);
+        return Monoid::combine(query_recursive(t.left, start, mid, l, r, pending),
+                               query_recursive(t.right, mid + 1, end, l, r, pending));
+    }
+
+public:
+    // Constructor: builds version 0 from arr
+    // Time Complexity: O(N)
+    // Space Complexity: 2*N nodes.
+    template <class E>
+    PersistentSegmentTree(const vector<E>& arr) {
+        n = arr.size();
+        roots.push_back(n == 0 ? 0 : build_recursive(arr, 0, n - 1));
+    }
+
+    // Applies 'val' to arr[l...r] of the latest version, creating a new one.
+    // An invalid range still creates a version, identical to the latest.
+    // Returns the number of the new version.
+    // Time and space complexity: O(log N).
+    int updateRange(int l, int r, const tag_type& val) {
+        int root = roots.back();
+        if (!(n == 0 || l < 0 || r >= n || l > r)) {
+            root = update_recursive(root, 0, n - 1, l, r, val);
+        }
+        roots.push_back(root);
+        return roots.size() - 1;
+    }
+
+    // Returns the aggregate of arr[l...r] as of 'version'
+    // Time complexity: O(log N).
+    value_type queryRange(int version, int l, int r) const {
+        if (n == 0 || l < 0 || r >= n || l > r || version < 0 || version >= (int)roots.size()) {
+            return Monoid::identity();
+        }
+        return query_recursive(roots[version], 0, n - 1, l, r, Action::identity());
+    }
+
+    // Returns the aggregate of arr[l...r] in the latest version
+    value_type queryRange(int l, int r) const {
+        return queryRange(versions() - 1, l, r);
+    }
+
+    // Number of versions (the latest is versions() - 1)
+    int versions() const { return roots.size(); }
+
+    // Nodes allocated over all versions
+    size_t nodeCount() const { return pool.size(); }
+};
+
+// Dynamic (implicit) segment tree over the 64-bit coordinate space
+// [0, 2^63 - 1), for sparse keys such as timestamps or IDs. Every element
+// starts as value_type() (0), and nodes are created from a NodePool only
+// where updates land. Paths are compressed: a node covers an aligned block
+// [lo, lo + 2^level) and its children may be any aligned blocks inside its
+// halves, so a point update into an empty region costs one or two nodes
+// instead of 63. As in PersistentSegmentTree, tags stay where they were
+// applied and are composed by queries, so tags must commute; the monoid
+// must be commutative too, and an all-zero range must aggregate to
+// value_type() (true for sum, min, max, xor and gcd).
+template <class Monoid = SumMonoid<long long>, class Action = RangeAddSum<long long>>
+class DynamicSegmentTree {
+    static_assert(isCommutative<Action>(),
+                  "DynamicSegmentTree keeps tags on their nodes and needs an Action with commutative = true");
+    static_assert(isCommutative<Monoid>(),
+                  "DynamicSegmentTree combines untouched ranges out of order and needs a Monoid with commutative = true");
+
+public:
+    using value_type = typename Monoid::value_type;
+    using tag_type = typename Action::tag_type;
+    using key_type = long long;
+
+    // Largest key. The domain stops one short of 2^63 so that every range,
+    // the full domain included, has a length that fits the long long the
+    // actions take. Ranges reaching past it are cut at MAX_KEY.
+    static constexpr key_type MAX_KEY = LLONG_MAX - 1;
+
+private:
+    struct Node {
+        value_type value;   // Aggregate of the block, including this node's tag
+        tag_type tag;       // Update applied to the whole block
+        unsigned long long lo; // First key of the block
+        int child[2];       // Nodes inside the lower and upper half (0 = none)
+        unsigned char level;   // The block holds 2^level keys
+    };
+
+    static constexpr int ROOT_LEVEL = 63; // The root slot covers [0, 2^63), which holds the domain
+
+    NodePool<Node> pool;
+    int root = 0;
+
+    static unsigned long long block_end(unsigned long long lo, int level) {
+        return lo + ((1ULL << level) - 1);
+    }
+
+    // Number of keys in [a, b], as the long long the actions take. Keys end
+    // at MAX_KEY, so it is at most 2^63 - 1: only a block of level 63 could
+    // be longer, and no range covers one whole.
+    static long long span_length(unsigned long long a, unsigned long long b) {
+        return (long long)(b - a + 1);
+    }
+
+    // Aggregate of a half of 'level' whose only content is child c
+    value_type half_value(int c, int level) const {
+        if (c == 0) return value_type();
+        const Node& t = pool[c];
+        return t.level == level ? t.value : Monoid::combine(t.value, value_type());
+    }
+
+    // Creates a node for the smallest aligned block holding [a, b]
+    int new_node(unsigned long long a, unsigned long long b) {
+        int level = a == b ? 0 : 64 - __builtin_clzll(a ^ b); // At most 63 for keys below 2^63
+        unsigned long long lo = a & ~((1ULL << level) - 1);
+        return pool.allocate({value_type(), Action::identity(), lo, {0, 0}, (unsigned char)level});
+    }
+
+    // Recursive function for range updates
+    // slot: child pointer of a half [hlo, hlo + 2^hlevel) that [l, r] overlaps
+    void update_slot(int& slot, unsigned long long hlo, int hlevel,
+                     unsigned long long l, unsigned long long r, const tag_type& val) {
+        unsigned long long a = max(l, hlo), b = min(r, block_end(hlo, hlevel));
+        if (slot == 0) {
+            slot = new_node(a, b);
+        } else {
+            const Node& x = pool[slot];
+            unsigned long long xhi = block_end(x.lo, x.level);
+            if (a < x.lo || b > xhi) {
+                // Insert a branching node above x that also holds [a, b]
+                int branch = new_node(min(a, x.lo), max(b, xhi));
+                Node& t = pool[branch];
+                int side = (x.lo >> (t.level - 1)) & 1;
+                t.child[side] = slot;
+                t.value = Monoid::combine(pool[slot].value, value_type());
+                slot = branch;
+            }
+        }
+        update_node(slot, a, b, val);
+    }
+
+    // Applies 'val' to [a, b], which lies inside node's block
+    void update_node(int node, unsigned long long a, unsigned long long b, const tag_type& val) {
+        Node& t = pool[node];
+        unsigned long long hi = block_end(t.lo, t.level);
+        if (a == t.lo && b == hi) {
+            t.value = Action::apply(t.value, val, span_length(a, b));
+            t.tag = Action::compose(val, t.tag);
+            return;
+        }
+        int half = t.level - 1;
+        unsigned long long mid = t.lo + (1ULL << half); // First key of the upper half
+        if (a < mid) update_slot(t.child[0], t.lo, half, a, b, val);
+        if (b >= mid) update_slot(t.child[1], mid, half, a, b, val);
+        t.value = Monoid::combine(half_value(t.child[0], half), half_value(t.child[1], half));
+        if (!(t.tag == Action::identity())) {
+            t.value = Action::apply(t.value, t.tag, span_length(t.lo, hi));
+        }
+    }
+
+    // Recursive function for range queries
+    // slot: child pointer of a half [hlo, hlo + 2^hlevel) that [l, r] overlaps
+    // pending: composition of the tags of all ancestors
+    value_type query_slot(int slot, unsigned long long hlo, int hlevel,
+                          unsigned long long l, unsigned long long r, tag_type pending) const {
+        unsigned long long a = max(l, hlo), b = min(r, block_end(hlo, hlevel));
+        if (slot == 0) {
+            return Action::apply(value_type(), pending, span_length(a, b));
+        }
+        const Node& t = pool[slot];
+        unsigned long long hi = block_end(t.lo, t.level);
+        unsigned long long xa = max(a, t.lo), xb = min(b, hi);
+        if (xa > xb) {
+            return Action::apply(value_type(), pending, span_length(a, b));
+        }
+        value_type result;
+        if (xa == t.lo && xb == hi) {
+            result = Action::apply(t.value, pending, span_length(xa, xb));
+        } else {
+            tag_type inner = Action::compose(pending, t.tag);
+            int half = t.level - 1;
+            unsigned long long mid = t.lo + (1ULL << half);
+            result = Monoid::identity();
+            if (xa < mid) result = Monoid::combine(result, query_slot(t.child[0], t.lo, half, xa, xb, inner));
+            if (xb >= mid) result = Monoid::combine(result, query_slot(t.child[1], mid, half, xa, xb, inner));
+        }
+        // Keys of [a, b] outside the node's block are untouched zeros
+        unsigned long long outside = (b - a) - (xb - xa);
+        if (outside > 0) {
+            result = Monoid::combine(result, Action::apply(value_type(), pending, (long long)outside));
+        }
+        return result;
+    }
+
+    static bool invalid(key_type l, key_type r) {
+        return l < 0 || r < 0 || l > r || l > MAX_KEY;
+    }
+
+public:
+    DynamicSegmentTree() = default;
+
+    // Applies 'val' to all keys in [l, r]
+    // Time complexity: O(log K) where K is the key range; at most
+    // O(log K) new nodes, far fewer when the touched keys are sparse.
+    void updateRange(key_type l, key_type r, const tag_type& val) {
+        if (invalid(l, r)) return;
+        update_slot(root, 0, ROOT_LEVEL, l, min(r, MAX_KEY), val);
+    }
+
+    // Returns the aggregate of all keys in [l, r]
+    // Time complexity: O(log K).
+    value_type queryRange(key_type l, key_type r) const {
+        if (invalid(l, r)) return Monoid::identity();
+        return query_slot(root, 0, ROOT_LEVEL, l, min(r, MAX_KEY), Action::identity());
+    }
+
+    // Nodes allocated so far, and the memory the pool holds for them
+    size_t nodeCount() const { return pool.size(); }
+    size_t memoryBytes() const { return pool.memoryBytes(); }
+};
+
+void runSegmentTreeTests() {
+    cout << "\nRunning Segment Tree Tests..." << endl;
+
+    // Test Case 1: Basic build and query
+    {
+        vector<int> arr = {1, 2, 3, 4, 5};
+        SegmentTree st(arr);
+        assert(st.queryRange(0, 4) == 15);
+        assert(st.queryRange(1, 3) == 9);
+        assert(st.queryRange(0, 0) == 1);
+        assert(st.queryRange(4, 4) == 5);
+        assert(st.queryRange(2, 2) == 3);
+        cout << "Test 1 passed." << endl;
+    }
+
+    // Test Case 2: Basic update and query
+    {
+        vector<int> arr = {1, 2, 3, 4, 5};
+        SegmentTree st(arr);
+        st.updateRange(1, 3, 10);
+        assert(st.queryRange(0, 4) == 45);
+        assert(st.queryRange(1, 3) == 39);
+        assert(st.queryRange(0, 1) == 13);
+        assert(st.queryRange(3, 4) == 19);
+        assert(st.queryRange(2, 2) == 13);
+        cout << "Test 2 passed." << endl;
+    }
+
+    // Test Case 3: Multiple updates
+    {
+        vector<int> arr = {1, 2, 3, 4, 5, 6, 7, 8};
+        SegmentTree st(arr);
+        st.updateRange(0, 7, 1);
+        st.updateRange(2, 5, -2);
+        // Expected arr: {2, 3, 2, 3, 4, 5, 8, 9}
+        assert(st.queryRange(0, 7) == (1+8)*8/2 + 8 + (-2)*4);
+        assert(st.queryRange(0, 1) == 2 + 3);
+        assert(st.queryRange(2, 5) == 2 + 3 + 4 + 5);
+        assert(st.queryRange(6, 7) == 8 + 9);
+        assert(st.queryRange(3, 4) == 3 + 4);
+        cout << "Test 3 passed." << endl;
+    }
+
+    // Test Case 4: Edge cases - single element array
+    {
+        vector<int> arr = {100};
+        SegmentTree st(arr);
+        assert(st.queryRange(0, 0) == 100);
+        st.updateRange(0, 0, 50);
+        assert(st.queryRange(0, 0) == 150);
+        cout << "Test 4 passed." << endl;
+    }
+
+    // Test Case 5: Edge cases - update/query invalid ranges
+    {
+        vector<int> arr = {1, 2, 3};
+        SegmentTree st(arr);
+        assert(st.queryRange(-1, 1) == 0);
+        assert(st.queryRange(2, 5) == 0);
+        assert(st.queryRange(3, 4) == 0);
+        st.updateRange(-1, 1, 10);
+        assert(st.queryRange(0, 2) == 1 + 2 + 3);
+        st.updateRange(2, 5, 5);
+        assert(st.queryRange(0, 2) == 1 + 2 + 3);
+        cout << "Test 5 passed." << endl;
+    }
+
+    // Test Case 6: Iterative engine matches a naive array on random operations
+    {
+        mt19937 rng(6);
+        for (int n = 1; n <= 40; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            IterativeSegmentTree it(arr);
+            SegmentTree st(arr);
+            for (int op = 0; op < 200; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    int val = (int)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    it.updateRange(l, r, val);
+                    st.updateRange(l, r, val);
+                } else {
+                    int expected = accumulate(arr.begin() + l, arr.begin() + r + 1, 0);
+                    assert(it.queryRange(l, r) == expected);
+                    assert(st.queryRange(l, r) == expected);
+                }
+            }
+        }
+        cout << "Test 6 passed." << endl;
+    }
+
+    // Test Case 7: Min/max with range add, xor and gcd through the policies
+    {
+        mt19937 rng(7);
+        for (int n = 1; n <= 40; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 100);
+            SegmentTree<MinMonoid<int>, RangeAdd<int>> st_min(arr);
+            IterativeSegmentTree<MinMonoid<int>, RangeAdd<int>> it_min(arr);
+            SegmentTree<MaxMonoid<int>, RangeAdd<int>> st_max(arr);
+            IterativeSegmentTree<MaxMonoid<int>, RangeAdd<int>> it_max(arr);
+            for (int op = 0; op < 200; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    int val = (int)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    st_min.updateRange(l, r, val);
+                    it_min.updateRange(l, r, val);
+                    st_max.updateRange(l, r, val);
+                    it_max.updateRange(l, r, val);
+                } else {
+                    int lo = *min_element(arr.begin() + l, arr.begin() + r + 1);
+                    int hi = *max_element(arr.begin() + l, arr.begin() + r + 1);
+                    assert(st_min.queryRange(l, r) == lo);
+                    assert(it_min.queryRange(l, r) == lo);
+                    assert(st_max.queryRange(l, r) == hi);
+                    assert(it_max.queryRange(l, r) == hi);
+                }
+            }
+        }
+        vector<int> arr = {12, 18, 30, 5, 6, 9};
+        SegmentTree<XorMonoid<int>, NoAction<int>> st_xor(arr);
+        IterativeSegmentTree<GcdMonoid<int>, NoAction<int>> it_gcd(arr);
+        assert(st_xor.queryRange(0, 2) == (12 ^ 18 ^ 30));
+        assert(st_xor.queryRange(3, 5) == (5 ^ 6 ^ 9));
+        assert(it_gcd.queryRange(0, 2) == 6);
+        assert(it_gcd.queryRange(4, 5) == 3);
+        assert(it_gcd.queryRange(2, 3) == 5);
+        cout << "Test 7 passed." << endl;
+    }
+
+    // Test Case 8: Wide accumulators do not overflow where int32 sums would
+    {
+        vector<int> arr(100000, 30000);
+        SegmentTree<SumMonoid<long long>, RangeAddSum<long long, int>> st(arr);
+        IterativeSegmentTree<SumMonoid<long long>, RangeAddSum<long long, int>> it(arr);
+        assert(st.queryRange(0, 99999) == 3000000000LL);
+        assert(it.queryRange(0, 99999) == 3000000000LL);
+        st.updateRange(0, 99999, 1000000000);
+        it.updateRange(0, 99999, 1000000000);
+        assert(st.queryRange(0, 99999) == 100003000000000LL);
+        assert(it.queryRange(0, 99999) == 100003000000000LL);
+        assert(st.queryRange(10, 10) == 1000030000LL);
+
+        vector<long long> big(8, 4000000000000000000LL);
+        SegmentTree<SumMonoid<__int128>, RangeAddSum<__int128, long long>> wide(big);
+        __int128 expected = (__int128)4000000000000000000LL * 8;
+        assert(wide.queryRange(0, 7) == expected);
+        wide.updateRange(2, 5, 5000000000000000000LL);
+        expected += (__int128)5000000000000000000LL * 4;
+        assert(wide.queryRange(0, 7) == expected);
+        cout << "Test 8 passed." << endl;
+    }
+
+    // Test Case 9: Blocked layout is a bijection and matches the heap layout
+    {
+        for (int n = 1; n <= 300; ++n) {
+            BlockedLayout<3> layout;
+            layout.init(n);
+            vector<bool> used(layout.size(), false);
+            int depth = 0;
+            while ((1 << depth) < n) ++depth;
+            for (int node = 1; node < (2 << depth); ++node) {
+                size_t slot = layout.index(node);
+                assert(slot < layout.size() && !used[slot]);
+                used[slot] = true;
+            }
+        }
+        mt19937 rng(9);
+        for (int n = 1; n <= 70; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            SegmentTree<SumMonoid<int>, RangeAddSum<int>, BlockedLayout<2>> blocked2(arr);
+            SegmentTree<SumMonoid<int>, RangeAddSum<int>, BlockedLayout<4>> blocked4(arr);
+            for (int op = 0; op < 200; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    int val = (int)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    blocked2.updateRange(l, r, val);
+                    blocked4.updateRange(l, r, val);
+                } else {
+                    int expected = accumulate(arr.begin() + l, arr.begin() + r + 1, 0);
+                    assert(blocked2.queryRange(l, r) == expected);
+                    assert(blocked4.queryRange(l, r) == expected);
+                }
+            }
+        }
+        cout << "Test 9 passed." << endl;
+    }
+
+    // Test Case 10: Packed node storage matches split storage
+    {
+        mt19937 rng(10);
+        for (int n = 1; n <= 70; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, PackedStorage> packed(arr);
+            SegmentTree<SumMonoid<long long>, RangeAddSum<long long, int>, BlockedLayout<4>, PackedStorage>
+                packed_wide(arr);
+            for (int op = 0; op < 200; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    int val = (int)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    packed.updateRange(l, r, val);
+                    packed_wide.updateRange(l, r, val);
+                } else {
+                    int expected = accumulate(arr.begin() + l, arr.begin() + r + 1, 0);
+                    assert(packed.queryRange(l, r) == expected);
+                    assert(packed_wide.queryRange(l, r) == expected);
+                }
+            }
+        }
+        static_assert(sizeof(PackedStorage::nodes<int, int>::Node) == 8);
+        static_assert(sizeof(PackedStorage::nodes<long long, int>::Node) == 16);
+        cout << "Test 10 passed." << endl;
+    }
+
+    // Test Case 11: Compact 2N tree matches a naive array for every small N
+    {
+        mt19937 rng(11);
+        for (int n = 1; n <= 70; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            CompactSegmentTree compact(arr);
+            CompactSegmentTree<MinMonoid<int>, RangeAdd<int>> compact_min(arr);
+            for (int op = 0; op < 300; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    int val = (int)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    compact.updateRange(l, r, val);
+                    compact_min.updateRange(l, r, val);
+                } else {
+                    assert(compact.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0));
+                    assert(compact_min.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                }
+            }
+        }
+        cout << "Test 11 passed." << endl;
+    }
+
+    // Test Case 12: Range assignment mixed with range addition
+    {
+        mt19937 rng(12);
+        for (int n = 1; n <= 50; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            SegmentTree<SumMonoid<long long>, RangeAssignAddSum<long long, int>> st(arr);
+            IterativeSegmentTree<SumMonoid<long long>, RangeAssignAddSum<long long, int>> it(arr);
+            CompactSegmentTree<SumMonoid<long long>, RangeAssignAddSum<long long, int>> compact(arr);
+            SegmentTree<MinMonoid<int>, RangeAssignAdd<int>, BlockedLayout<2>, PackedStorage> st_min(arr);
+            CompactSegmentTree<MaxMonoid<int>, RangeAssignAdd<int>> compact_max(arr);
+            for (int op = 0; op < 300; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                int val = (int)(rng() % 21) - 10;
+                switch (rng() % 3) {
+                case 0:
+                    for (int i = l; i <= r; ++i) arr[i] = val;
+                    st.assignRange(l, r, val);
+                    it.assignRange(l, r, val);
+                    compact.assignRange(l, r, val);
+                    st_min.assignRange(l, r, val);
+                    compact_max.assignRange(l, r, val);
+                    break;
+                case 1:
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    st.updateRange(l, r, val);
+                    it.updateRange(l, r, val);
+                    compact.updateRange(l, r, val);
+                    st_min.updateRange(l, r, val);
+                    compact_max.updateRange(l, r, val);
+                    break;
+                default: {
+                    long long sum = accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL);
+                    assert(st.queryRange(l, r) == sum);
+                    assert(it.queryRange(l, r) == sum);
+                    assert(compact.queryRange(l, r) == sum);
+                    assert(st_min.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                    assert(compact_max.queryRange(l, r) == *max_element(arr.begin() + l, arr.begin() + r + 1));
+                }
+                }
+            }
+        }
+        // Resetting a window to zero is one call, no query-then-add
+        vector<int> counters = {5, 7, 9, 11, 13};
+        SegmentTree<SumMonoid<int>, RangeAssignAddSum<int>> window(counters);
+        window.assignRange(1, 3, 0);
+        assert(window.queryRange(0, 4) == 18);
+        window.updateRange(0, 4, 1);
+        assert(window.queryRange(1, 3) == 3);
+        cout << "Test 12 passed." << endl;
+    }
+
+    // Test Case 13: Segment Tree Beats against a naive array
+    {
+        mt19937 rng(13);
+        for (int n = 1; n <= 50; ++n) {
+            vector<long long> arr(n);
+            for (long long& x : arr) x = (long long)(rng() % 201) - 100;
+            SegmentTreeBeats<long long> beats(arr);
+            for (int op = 0; op < 400; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                long long val = (long long)(rng() % 201) - 100;
+                switch (rng() % 4) {
+                case 0:
+                    for (int i = l; i <= r; ++i) arr[i] = min(arr[i], val);
+                    beats.chminRange(l, r, val);
+                    break;
+                case 1:
+                    for (int i = l; i <= r; ++i) arr[i] = max(arr[i], val);
+                    beats.chmaxRange(l, r, val);
+                    break;
+                case 2:
+                    for (int i = l; i <= r; ++i) arr[i] += val / 4;
+                    beats.updateRange(l, r, val / 4);
+                    break;
+                default:
+                    assert(beats.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                    assert(beats.queryMax(l, r) == *max_element(arr.begin() + l, arr.begin() + r + 1));
+                    assert(beats.queryMin(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                }
+            }
+        }
+        // Rate limiting: cap every counter at 10
+        vector<int> counters = {3, 15, 8, 40, 10, 12};
+        SegmentTreeBeats<long long> limits(counters);
+        limits.chminRange(0, 5, 10);
+        assert(limits.queryRange(0, 5) == 3 + 10 + 8 + 10 + 10 + 10);
+        assert(limits.queryMax(0, 5) == 10);
+        cout << "Test 13 passed." << endl;
+    }
+
+    // Test Case 14: Batched updates match the same updates applied one by one
+    {
+        mt19937 rng(14);
+        for (int n = 1; n <= 40; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            using AssignTree = SegmentTree<SumMonoid<long long>, RangeAssignAddSum<long long, int>>;
+            AssignTree batched(arr), looped(arr);
+            SegmentTree<MinMonoid<int>, RangeAdd<int>, BlockedLayout<2>, PackedStorage> batched_min(arr);
+            for (int round = 0; round < 20; ++round) {
+                vector<AssignTree::Update> batch;
+                vector<SegmentTree<MinMonoid<int>, RangeAdd<int>, BlockedLayout<2>, PackedStorage>::Update> adds;
+                int size = rng() % 12;
+                for (int k = 0; k < size; ++k) {
+                    int l = (int)(rng() % (n + 2)) - 1, r = (int)(rng() % (n + 2)) - 1;
+                    if (rng() % 4 && l > r) swap(l, r);
+                    int val = (int)(rng() % 21) - 10;
+                    auto tag = rng() % 2 ? RangeAssignAddSum<long long, int>::assign(val) : AssignAddTag<int>(val);
+                    batch.push_back({l, r, tag});
+                    adds.push_back({l, r, val});
+                    looped.updateRange(l, r, tag);
+                    if (l >= 0 && r < n && l <= r) {
+                        for (int i = l; i <= r; ++i) arr[i] += val;
+                    }
+                }
+                batched.applyBatch(batch);
+                batched_min.applyBatch(adds);
+                for (int l = 0; l < n; ++l) {
+                    for (int r = l; r < n; ++r) {
+                        assert(batched.queryRange(l, r) == looped.queryRange(l, r));
+                        assert(batched_min.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                    }
+                }
+            }
+        }
+        cout << "Test 14 passed." << endl;
+    }
+
+    // Test Case 15: Batched queries match repeated queryRange
+    {
+        mt19937 rng(15);
+        for (int n = 1; n <= 40; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            SegmentTree<> st(arr), reference(arr);
+            SegmentTree<MaxMonoid<int>, RangeAdd<int>, BlockedLayout<2>, PackedStorage> st_max(arr);
+            for (int round = 0; round < 20; ++round) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                int val = (int)(rng() % 21) - 10;
+                st.updateRange(l, r, val);
+                reference.updateRange(l, r, val);
+                st_max.updateRange(l, r, val);
+                for (int i = l; i <= r; ++i) arr[i] += val;
+
+                vector<pair<int, int>> ranges;
+                int size = rng() % 30;
+                for (int k = 0; k < size; ++k) {
+                    int ql = (int)(rng() % (n + 2)) - 1, qr = (int)(rng() % (n + 2)) - 1;
+                    if (rng() % 4 && ql > qr) swap(ql, qr);
+                    ranges.push_back({ql, qr});
+                }
+                vector<int> sums(ranges.size()), maxima(ranges.size());
+                st.queryBatch(ranges, sums);
+                st_max.queryBatch(ranges, maxima);
+                for (size_t k = 0; k < ranges.size(); ++k) {
+                    auto [ql, qr] = ranges[k];
+                    assert(sums[k] == reference.queryRange(ql, qr));
+                    if (ql >= 0 && qr < n && ql <= qr) {
+                        assert(maxima[k] == *max_element(arr.begin() + ql, arr.begin() + qr + 1));
+                    } else {
+                        assert(maxima[k] == numeric_limits<int>::lowest());
+                    }
+                }
+            }
+        }
+        cout << "Test 15 passed." << endl;
+    }
+
+    // Test Case 16: Parallel construction builds the same tree
+    {
+        mt19937 rng(16);
+        for (int n = 1; n <= 40; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            SegmentTree<> sequential(arr);
+            for (unsigned threads = 1; threads <= 5; ++threads) {
+                SegmentTree<MinMonoid<int>, RangeAdd<int>, BlockedLayout<2>, PackedStorage> parallel_min(arr, threads);
+                SegmentTree<> parallel(arr, threads);
+                for (int l = 0; l < n; ++l) {
+                    for (int r = l; r < n; ++r) {
+                        assert(parallel.queryRange(l, r) == sequential.queryRange(l, r));
+                        assert(parallel_min.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                    }
+                }
+            }
+        }
+        vector<int> arr(100000);
+        for (int& x : arr) x = (int)(rng() % 21) - 10;
+        SegmentTree<> parallel(arr, 0);
+        assert(parallel.queryRange(0, 99999) == accumulate(arr.begin(), arr.end(), 0));
+        SegmentTree<> clamped(arr, UINT_MAX); // Clamped to the hardware, not 2^32 threads
+        assert(clamped.queryRange(0, 99999) == accumulate(arr.begin(), arr.end(), 0));
+        cout << "Test 16 passed." << endl;
+    }
+
+    // Test Case 17: Concurrent tree answers like SegmentTree, and readers
+    // running next to a writer only ever see whole updates
+    {
+        mt19937 rng(17);
+        for (int n = 1; n <= 40; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            ConcurrentSegmentTree<> shared(arr);
+            ConcurrentSegmentTree<MaxMonoid<long long>, RangeAdd<long long>> shared_max(arr);
+            for (int op = 0; op < 200; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    int val = (int)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    shared.updateRange(l, r, val);
+                    shared_max.updateRange(l, r, val);
+                } else {
+                    assert(shared.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0));
+                    assert(shared_max.queryRange(l, r) == *max_element(arr.begin() + l, arr.begin() + r + 1));
+                }
+            }
+        }
+
+        vector<int> arr(1000, 1);
+        ConcurrentSegmentTree<> shared(arr);
+        atomic<bool> done{false};
+        // The writer toggles +5/-5 on [3, 20], so every consistent total is 1000 or 1090
+        thread writer([&] {
+            for (int i = 0; i < 20000; ++i) {
+                shared.updateRange(3, 20, (i & 1) ? -5 : 5);
+            }
+            done = true;
+        });
+        vector<thread> readers;
+        atomic<int> bad{0};
+        for (int t = 0; t < 3; ++t) {
+            readers.emplace_back([&] {
+                while (!done) {
+                    int total = shared.queryRange(0, 999);
+                    if (total != 1000 && total != 1090) ++bad;
+                }
+            });
+        }
+        writer.join();
+        for (thread& reader : readers) reader.join();
+        assert(bad == 0);
+        assert(shared.queryRange(0, 999) == 1000);
+        cout << "Test 17 passed." << endl;
+    }
+
+    // Test Case 18: Const queries see pending tags without pushing them
+    {
+        mt19937 rng(18);
+        for (int n = 1; n <= 50; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            SegmentTree<SumMonoid<long long>, RangeAssignAddSum<long long, int>, BlockedLayout<2>> st(arr);
+            vector<int> arr_min = arr;
+            SegmentTree<MinMonoid<int>, RangeAdd<int>, HeapLayout, PackedStorage> st_min(arr_min);
+            const auto& view = st;
+            const auto& view_min = st_min;
+            for (int op = 0; op < 300; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                int val = (int)(rng() % 21) - 10;
+                switch (rng() % 3) {
+                case 0:
+                    for (int i = l; i <= r; ++i) arr[i] = val;
+                    st.assignRange(l, r, val);
+                    break;
+                case 1:
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    for (int i = l; i <= r; ++i) arr_min[i] += val;
+                    st.updateRange(l, r, val);
+                    st_min.updateRange(l, r, val);
+                    break;
+                default:
+                    assert(view.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                    assert(view_min.queryRange(l, r) == *min_element(arr_min.begin() + l, arr_min.begin() + r + 1));
+                }
+            }
+        }
+        cout << "Test 18 passed." << endl;
+    }
+
+    // Test Case 19: Persistent tree keeps every version queryable
+    {
+        mt19937 rng(19);
+        for (int n = 1; n <= 30; ++n) {
+            vector<int> arr(n);
+            for (int& x : arr) x = (int)(rng() % 21) - 10;
+            PersistentSegmentTree<> history(arr);
+            PersistentSegmentTree<MaxMonoid<int>, RangeAdd<int>> history_max(arr);
+            vector<vector<int>> snapshots = {arr};
+            for (int op = 0; op < 60; ++op) {
+                int l = (int)(rng() % (n + 1)) - 1, r = rng() % n;
+                if (l > r) swap(l, r);
+                int val = (int)(rng() % 21) - 10;
+                if (l >= 0) {
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                }
+                assert(history.updateRange(l, r, val) == op + 1);
+                history_max.updateRange(l, r, val);
+                snapshots.push_back(arr);
+            }
+            for (int version = 0; version < history.versions(); ++version) {
+                const vector<int>& old = snapshots[version];
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                assert(history.queryRange(version, l, r) == accumulate(old.begin() + l, old.begin() + r + 1, 0LL));
+                assert(history_max.queryRange(version, l, r) == *max_element(old.begin() + l, old.begin() + r + 1));
+            }
+        }
+        // Each update copies O(log N) nodes, not the whole tree
+        vector<int> arr(1 << 16, 1);
+        PersistentSegmentTree<> history(arr);
+        size_t base = history.nodeCount();
+        for (int i = 0; i < 1000; ++i) history.updateRange(i, (1 << 16) - 1 - i, 1);
+        assert(history.nodeCount() - base <= 1000 * 4 * 17);
+        assert(history.queryRange(0, 0, (1 << 16) - 1) == (1 << 16));
+        cout << "Test 19 passed." << endl;
+    }
+
+    // Test Case 20: Dynamic tree over sparse 64-bit keys
+    {
+        mt19937_64 rng(20);
+        const long long bases[] = {0, 1LL << 40, (1LL << 62) + 12345, DynamicSegmentTree<>::MAX_KEY - 63};
+        for (long long base : bases) {
+            vector<long long> arr(64, 0);
+            DynamicSegmentTree<> sparse;
+            DynamicSegmentTree<MinMonoid<long long>, RangeAdd<long long>> sparse_min;
+            for (int op = 0; op < 2000; ++op) {
+                int l = rng() % 64, r = rng() % 64;
+                if (l > r) swap(l, r);
+                if (rng() % 4 == 0) r = l; // Many point updates
+                if (rng() % 2) {
+                    long long val = (long long)(rng() % 21) - 10;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    sparse.updateRange(base + l, base + r, val);
+                    sparse_min.updateRange(base + l, base + r, val);
+                } else {
+                    assert(sparse.queryRange(base + l, base + r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                    assert(sparse_min.queryRange(base + l, base + r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                }
+            }
+            // Keys outside the touched window are still zero
+            long long total = accumulate(arr.begin(), arr.end(), 0LL);
+            assert(sparse.queryRange(0, LLONG_MAX) == total);
+            if (base > 0) {
+                assert(sparse.queryRange(0, base - 1) == 0);
+                assert(sparse_min.queryRange(0, base + 63) == min(0LL, *min_element(arr.begin(), arr.end())));
+            }
+        }
+        // Scattered point updates cost O(1) nodes each, not O(63)
+        DynamicSegmentTree<> counts;
+        long long expected = 0;
+        for (int i = 0; i < 10000; ++i) {
+            long long key = (long long)(rng() >> 1);
+            counts.updateRange(key, key, 1 + i % 3);
+            expected += 1 + i % 3;
+        }
+        assert(counts.queryRange(0, LLONG_MAX) == expected);
+        assert(counts.nodeCount() <= 2 * 10000);
+
+        // Updates and queries of the whole domain: its length, 2^63 - 1,
+        // still fits the actions' long long
+        {
+            const long long max_key = DynamicSegmentTree<>::MAX_KEY;
+            DynamicSegmentTree<> whole;
+            DynamicSegmentTree<MinMonoid<long long>, RangeAdd<long long>> whole_min;
+            whole.updateRange(0, max_key, 1);
+            whole_min.updateRange(0, LLONG_MAX, 3); // Cut at MAX_KEY
+            assert(whole.queryRange(0, max_key) == LLONG_MAX);
+            assert(whole.queryRange(0, LLONG_MAX) == LLONG_MAX);
+            assert(whole.queryRange(1, max_key) == LLONG_MAX - 1);
+            assert(whole.queryRange(LLONG_MAX, LLONG_MAX) == 0); // Past the domain
+            whole.updateRange(1LL << 62, max_key, -1);
+            assert(whole.queryRange(0, LLONG_MAX) == 1LL << 62);
+            whole_min.updateRange(max_key, max_key, -4);
+            assert(whole_min.queryRange(0, LLONG_MAX) == -1);
+            assert(whole_min.queryRange(0, max_key - 1) == 3);
         }
+        cout << "Test 20 passed." << endl;
     }
 
-    // Recursive function to build the segment tree
-    // arr: initial array
-    // node: current segment tree node index
-    // start, end: range covered by this node (0-indexed based on original array)
-    void build_recursive(const vector<int>& arr, int node, int start, int end) {
-        if (start == end) {
-            tree[node] = (int)arr[start];
-            return;
+#ifdef __linux__
+    // Test Case 21: Save to a file and map it back
+    {
+        string path = (filesystem::temp_directory_path() / "segment_tree_test_21.bin").string();
+        mt19937 rng(21);
+        int size = 1000;
+        vector<int> arr(size);
+        for (int& x : arr) x = rng() % 100;
+        SegmentTree<> original(arr);
+        SegmentTree<MinMonoid<int>, RangeAdd<int>, BlockedLayout<4>, PackedStorage> original_min(arr);
+        for (int op = 0; op < 500; ++op) {
+            int l = rng() % size, r = rng() % size;
+            if (l > r) swap(l, r);
+            original.updateRange(l, r, op % 7 - 3);
+            original_min.updateRange(l, r, op % 7 - 3);
         }
-        int mid = start + (end - start) / 2;
-        build_recursive(arr, 2 * node, start, mid);
-        build_recursive(arr, 2 * node + 1, mid + 1, end);
-        tree[node] = tree[2 * node] + tree[2 * node + 1];
-    }
+        original.save(path);
 
-    // Recursive function for range updates
-    // node: current segment tree node index
-    // start, end: range covered by this node
-    // l, r: update range query (0-indexed)
-    // val: value to add
-    void update_recursive(int node, int start, int end, int l, int r, int val) {
-        push(node, start, end);
+        // Read-only: pending tags are in the file, const queries see them
+        {
+            const SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, MappedStorage> mapped(path, MapMode::ReadOnly, true);
+            for (int i = 0; i < 200; ++i) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                assert(mapped.queryRange(l, r) == original.queryRange(l, r));
+            }
+        }
 
-        // Case 1: Current segment [start, end] is completely outside the update range [l, r]
-        if (start > end || start > r || end < l) {
-            return;
+        // Copy-on-write: updates work and stay private to the mapping
+        {
+            SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, MappedStorage> mapped(path, MapMode::CopyOnWrite);
+            SegmentTree<> reference = original;
+            for (int op = 0; op < 200; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                if (op % 2) {
+                    mapped.updateRange(l, r, 5);
+                    reference.updateRange(l, r, 5);
+                } else {
+                    assert(mapped.queryRange(l, r) == reference.queryRange(l, r));
+                }
+            }
+            const SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, MappedStorage> unchanged(path, MapMode::ReadOnly, true);
+            assert(unchanged.queryRange(0, size - 1) == original.queryRange(0, size - 1));
         }
 
-        // Case 2: Current segment [start, end] is completely inside the update range [l, r]
-        if (l <= start && end <= r) {
-            tree[node] += (int)val * (end - start + 1);
-            if (start != end) {
-                lazy[2 * node] += val;
-                lazy[2 * node + 1] += val;
+        // Packed storage and a blocked layout write the same format
+        original_min.save(path);
+        {
+            const SegmentTree<MinMonoid<int>, RangeAdd<int>, BlockedLayout<4>, MappedStorage> mapped(path, MapMode::ReadOnly, true);
+            for (int l = 0; l < size; l += 37) {
+                assert(mapped.queryRange(l, size - 1) == original_min.queryRange(l, size - 1));
             }
-            return;
         }
 
-        // Case 3: Partial overlap. Recurse on children.
-        int mid = start + (end - start) / 2;
-        update_recursive(2 * node, start, mid, l, r, val);
-        update_recursive(2 * node + 1, mid + 1, end, l, r, val);
+        using MappedMin = SegmentTree<MinMonoid<int>, RangeAdd<int>, BlockedLayout<4>, MappedStorage>;
+        // Mismatched types and corrupted files are rejected
+        auto rejects = [&](auto open) {
+            try {
+                open();
+            } catch (const runtime_error&) {
+                return true;
+            }
+            return false;
+        };
+        assert(rejects([&] { SegmentTree<MinMonoid<int>, RangeAdd<int>, HeapLayout, MappedStorage> t(path); }));
 
-        tree[node] = tree[2 * node] + tree[2 * node + 1];
+        // A default (read-only) open refuses every method that writes nodes,
+        // non-const queries included, instead of faulting on the mapped pages
+        {
+            MappedMin opened(path);
+            vector<pair<int, int>> ranges = {{0, 1}};
+            vector<int> results(1);
+            vector<MappedMin::Update> updates = {{0, 1, 1}};
+            assert(rejects([&] { opened.updateRange(0, 1, 1); }));
+            assert(rejects([&] { opened.queryRange(0, 1); }));
+            assert(rejects([&] { opened.pointAdd(0, 1); }));
+            assert(rejects([&] { opened.pointSet(0, 1); }));
+            assert(rejects([&] { opened.applyBatch(updates); }));
+            assert(rejects([&] { opened.queryBatch(ranges, results); }));
+            assert(rejects([&] { opened.maxRight(0, [](int) { return true; }); }));
+            const MappedMin& read = opened;
+            assert(read.queryRange(0, size - 1) == original_min.queryRange(0, size - 1));
+            assert(read.pointGet(3) == original_min.pointGet(3));
+        }
+        assert(rejects([&] { SegmentTree<MaxMonoid<int>, RangeAdd<int>, BlockedLayout<4>, MappedStorage> t(path); }));
+        auto patch = [&](long offset) {
+            FILE* f = fopen(path.c_str(), "r+b");
+            fseek(f, offset, SEEK_SET);
+            int byte = fgetc(f);
+            fseek(f, offset, SEEK_SET);
+            fputc(byte ^ 1, f);
+            fclose(f);
+        };
+        patch(TREE_FILE_ALIGN + 8); // A value: only a verified open notices
+        assert(!rejects([&] { MappedMin t(path); }));
+        assert(rejects([&] { MappedMin t(path, MapMode::ReadOnly, true); }));
+        patch(offsetof(TreeFileHeader, n)); // The header is always checked
+        assert(rejects([&] { MappedMin t(path); }));
+        filesystem::remove(path);
+        assert(rejects([&] { MappedMin t(path); }));
+        cout << "Test 21 passed." << endl;
     }
+#endif
 
-    // Recursive function for range queries
-    // node: current segment tree node index
-    // start, end: range covered by this node
-    // l, r: query range (0-indexed)
-    int query_recursive(int node, int start, int end, int l, int r) {
-        // Case 1: Current segment [start, end] is completely outside the query range [l, r]
-        if (start > end || start > r || end < l) {
-            return 0;
-        }
+    // Test Case 22: Work counters
+    {
+        vector<int> arr(16, 1);
+        SegmentTree<> st(arr);
+        st.queryRange(0, 15);
+#ifdef SEGMENT_TREE_STATS
+        SegmentTreeStats full = st.lastStats();
+        assert(full.operations == 1 && full.nodes_visited == 1 && full.splits == 0 && full.max_depth == 0);
 
-        push(node, start, end);
+        st.queryRange(5, 5); // Root-to-leaf path plus the sibling at every level
+        SegmentTreeStats point = st.lastStats();
+        assert(point.nodes_visited == 9 && point.splits == 4 && point.max_depth == 4 && point.pushes == 0);
 
-        // Case 2: Current segment [start, end] is completely inside the query range [l, r]
-        if (l <= start && end <= r) {
-            return tree[node];
-        }
+        st.updateRange(0, 7, 3); // Covers the left child: tags on its two children
+        SegmentTreeStats update = st.lastStats();
+        assert(update.nodes_visited == 3 && update.splits == 1 && update.tag_writes == 2 && update.pushes == 0);
 
-        // Case 3: Partial overlap. Recurse on children and combine results.
-        int mid = start + (end - start) / 2;
-        int p1 = query_recursive(2 * node, start, mid, l, r);
-        int p2 = query_recursive(2 * node + 1, mid + 1, end, l, r);
-        return p1 + p2;
-    }
+        assert(st.queryRange(0, 0) == 4); // Pushes [0, 3], [0, 1] and the leaf
+        SegmentTreeStats pushed = st.lastStats();
+        assert(pushed.nodes_visited == 9 && pushed.pushes == 3 && pushed.tag_writes == 4);
 
-public:
-    // Constructor
-    // arr: initial array
-    // Time Complexity: O(N)
-    // Space Complexity: O(N) for tree and lazy arrays.
-    SegmentTree(const vector<int>& arr) {
-        n = arr.size();
-        if (n == 0) return;
-        tree.resize(4 * n); // Segment tree needs up to 4*n space
-        lazy.resize(4 * n, 0); // Initialize lazy values to 0 (no pending update)
-        build_recursive(arr, ROOT_NODE, 0, n - 1);
+        SegmentTreeStats total = st.totalStats();
+        assert(total.operations == 4);
+        assert(total.nodes_visited == full.nodes_visited + point.nodes_visited + update.nodes_visited + pushed.nodes_visited);
+        assert(total.max_depth == 4);
+
+        const SegmentTree<>& read_only = st;
+        read_only.queryRange(0, 15);
+        assert(st.lastStats().nodes_visited == 1 && st.totalStats().operations == 5);
+        st.resetStats();
+        assert(st.totalStats().operations == 0 && st.lastStats().nodes_visited == 0);
+#else
+        // Compiled out: the counters stay zero
+        st.updateRange(0, 7, 3);
+        assert(st.lastStats().nodes_visited == 0 && st.totalStats().operations == 0);
+#endif
+        cout << "Test 22 passed." << endl;
     }
 
-    // Public method for range update
-    // Adds 'val' to all elements in arr[l...r]
-    // Time complexity: O(log N) where N is the size of the original array.
-    void updateRange(int l, int r, int val) {
-        if (n == 0 || l < 0 || r >= n || l > r) {
-            return;
+    // Test Case 23: Prefix search and maxRight descend through pending tags
+    {
+        mt19937 rng(23);
+        for (int size : {1, 2, 7, 64, 1000}) {
+            vector<long long> arr(size);
+            for (long long& x : arr) x = rng() % 10;
+            SegmentTree<SumMonoid<long long>, RangeAddSum<long long>> sums(arr);
+            SegmentTree<MaxMonoid<long long>, RangeAdd<long long>> maxima(arr);
+            for (int op = 0; op < 300; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                long long val = rng() % 5; // Non-negative, so prefix sums stay monotone
+                for (int i = l; i <= r; ++i) arr[i] += val;
+                sums.updateRange(l, r, val);
+                maxima.updateRange(l, r, val);
+
+                vector<long long> prefix(size);
+                partial_sum(arr.begin(), arr.end(), prefix.begin());
+                long long x = (long long)(rng() % (prefix.back() + 2));
+                int expected = lower_bound(prefix.begin(), prefix.end(), x) - prefix.begin();
+                assert(sums.lowerBoundPrefix(x) == expected);
+
+                int start = rng() % (size + 1);
+                long long limit = rng() % 30;
+                int expected_right = start - 1;
+                while (expected_right + 1 < size && arr[expected_right + 1] < limit) ++expected_right;
+                assert(maxima.maxRight(start, [&](long long v) { return v < limit; }) == expected_right);
+            }
+            assert(sums.lowerBoundPrefix(0) == 0);
+            assert(sums.lowerBoundPrefix(LLONG_MAX) == size);
+            assert(sums.maxRight(size, [](long long) { return true; }) == size - 1);
         }
-        update_recursive(ROOT_NODE, 0, n - 1, l, r, val);
+        cout << "Test 23 passed." << endl;
     }
 
-    // Public method for range query
-    // Returns sum of elements in arr[l...r]
-    // Time complexity: O(log N) where N is the size of the original array.
-    int queryRange(int l, int r) {
-        if (n == 0 || l < 0 || r >= n || l > r) {
-            return 0;
+    // Test Case 24: Sum, min, max and their positions from one tree
+    {
+        mt19937 rng(24);
+        for (int size : {1, 5, 100, 777}) {
+            vector<long long> arr(size);
+            for (long long& x : arr) x = (long long)(rng() % 21) - 10;
+            SegmentTree<SummaryMonoid<long long>, RangeAddSummary<long long>> st(arr);
+            IterativeSegmentTree<SummaryMonoid<long long>, RangeAddSummary<long long>> it(arr);
+            for (int op = 0; op < 1000; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    long long val = (long long)(rng() % 7) - 3;
+                    for (int i = l; i <= r; ++i) arr[i] += val;
+                    st.updateRange(l, r, val);
+                    it.updateRange(l, r, val);
+                } else {
+                    int expected_max = max_element(arr.begin() + l, arr.begin() + r + 1) - arr.begin();
+                    int expected_min = min_element(arr.begin() + l, arr.begin() + r + 1) - arr.begin();
+                    long long expected_sum = accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL);
+                    for (Summary<long long> s : {st.queryRange(l, r), it.queryRange(l, r)}) {
+                        assert(s.sum == expected_sum);
+                        assert(s.max == arr[expected_max] && s.argmax == expected_max);
+                        assert(s.min == arr[expected_min] && s.argmin == expected_min);
+                    }
+                }
+            }
         }
-        return query_recursive(ROOT_NODE, 0, n - 1, l, r);
+        cout << "Test 24 passed." << endl;
     }
-};
-
-
-void runSegmentTreeTests() {
-    cout << "\nRunning Segment Tree Tests..." << endl;
 
-    // Test Case 1: Basic build and query
+    // Test Case 25: Affine range updates modulo a prime, static and Barrett
     {
-        vector<int> arr = {1, 2, 3, 4, 5};
-        SegmentTree st(arr);
-        assert(st.queryRange(0, 4) == 15);
-        assert(st.queryRange(1, 3) == 9);
-        assert(st.queryRange(0, 0) == 1);
-        assert(st.queryRange(4, 4) == 5);
-        assert(st.queryRange(2, 2) == 3);
-        cout << "Test 1 passed." << endl;
+        mt19937 rng(25);
+        for (uint32_t m : {998244353u, 1000000007u, 7u, 1u}) {
+            BarrettMod<25>::setModulus(m);
+            for (int i = 0; i < 10000; ++i) {
+                uint32_t a = rng() % m, b = rng() % m;
+                assert(BarrettMod<25>::mul(a, b) == (uint64_t)a * b % m);
+            }
+            assert(BarrettMod<25>::mul(m - 1, m - 1) == (uint64_t)(m - 1) * (m - 1) % m);
+        }
+        BarrettMod<25>::setModulus(1000000007);
+        const uint64_t P = 998244353, Q = 1000000007;
+        int size = 300;
+        vector<long long> arr(size);
+        for (long long& x : arr) x = (long long)(rng() % 2000000) - 1000000;
+        vector<uint64_t> naive_p(size), naive_q(size);
+        for (int i = 0; i < size; ++i) {
+            naive_p[i] = (arr[i] % (long long)P + P) % P;
+            naive_q[i] = (arr[i] % (long long)Q + Q) % Q;
+        }
+        SegmentTree<ModSumMonoid<StaticMod<998244353>>, RangeAffineMod<StaticMod<998244353>>> fixed(arr);
+        SegmentTree<ModSumMonoid<BarrettMod<25>>, RangeAffineMod<BarrettMod<25>>> runtime(arr);
+        for (int op = 0; op < 2000; ++op) {
+            int l = rng() % size, r = rng() % size;
+            if (l > r) swap(l, r);
+            if (rng() % 2) {
+                uint32_t b = rng() % 1000, c = rng() % 1000000;
+                for (int i = l; i <= r; ++i) {
+                    naive_p[i] = (naive_p[i] * b + c) % P;
+                    naive_q[i] = (naive_q[i] * b + c) % Q;
+                }
+                fixed.updateRange(l, r, AffineTag{b, c});
+                runtime.updateRange(l, r, AffineTag{b, c});
+            } else {
+                uint64_t sum_p = 0, sum_q = 0;
+                for (int i = l; i <= r; ++i) {
+                    sum_p = (sum_p + naive_p[i]) % P;
+                    sum_q = (sum_q + naive_q[i]) % Q;
+                }
+                assert(fixed.queryRange(l, r) == sum_p);
+                assert(runtime.queryRange(l, r) == sum_q);
+            }
+        }
+        cout << "Test 25 passed." << endl;
     }
 
-    // Test Case 2: Basic update and query
+    // Test Case 26: Best window sum under range assignment
     {
-        vector<int> arr = {1, 2, 3, 4, 5};
-        SegmentTree st(arr);
-        st.updateRange(1, 3, 10);
-        assert(st.queryRange(0, 4) == 45);
-        assert(st.queryRange(1, 3) == 39);
-        assert(st.queryRange(0, 1) == 13);
-        assert(st.queryRange(3, 4) == 19);
-        assert(st.queryRange(2, 2) == 13);
-        cout << "Test 2 passed." << endl;
+        mt19937 rng(26);
+        for (int size : {1, 3, 50, 500}) {
+            vector<long long> arr(size);
+            for (long long& x : arr) x = (long long)(rng() % 21) - 10;
+            SegmentTree<MaxSubarrayMonoid<long long>, RangeAssignMaxSubarray<long long>> st(arr);
+            for (int op = 0; op < 1000; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                if (rng() % 3 == 0) {
+                    long long val = (long long)(rng() % 21) - 10;
+                    fill(arr.begin() + l, arr.begin() + r + 1, val);
+                    st.assignRange(l, r, val);
+                } else {
+                    long long best = LLONG_MIN, ending_here = 0; // Kadane over arr[l...r]
+                    for (int i = l; i <= r; ++i) {
+                        ending_here = max(ending_here + arr[i], arr[i]);
+                        best = max(best, ending_here);
+                    }
+                    MaxSubarray<long long> result = st.queryRange(l, r);
+                    assert(!result.empty && result.best == best);
+                    assert(result.sum == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                }
+            }
+        }
+        cout << "Test 26 passed." << endl;
     }
 
-    // Test Case 3: Multiple updates
+    // Test Case 27: Wide (16-ary) tree sums with point updates
     {
-        vector<int> arr = {1, 2, 3, 4, 5, 6, 7, 8};
-        SegmentTree st(arr);
-        st.updateRange(0, 7, 1);
-        st.updateRange(2, 5, -2);
-        // Expected arr: {2, 3, 2, 3, 4, 5, 8, 9}
-        assert(st.queryRange(0, 7) == (1+8)*8/2 + 8 + (-2)*4);
-        assert(st.queryRange(0, 1) == 2 + 3);
-        assert(st.queryRange(2, 5) == 2 + 3 + 4 + 5);
-        assert(st.queryRange(6, 7) == 8 + 9);
-        assert(st.queryRange(3, 4) == 3 + 4);
-        cout << "Test 3 passed." << endl;
+        mt19937 rng(27);
+        for (int size : {1, 15, 16, 17, 255, 256, 257, 5000}) {
+            vector<long long> arr(size);
+            for (long long& x : arr) x = (long long)(rng() % 201) - 100;
+            WideSegmentTree<long long> wide(arr);
+            WideSegmentTree<int> wide32(arr);
+            for (int op = 0; op < 2000; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                if (rng() % 2) {
+                    long long val = (long long)(rng() % 201) - 100;
+                    arr[l] += val;
+                    wide.pointAdd(l, val);
+                    wide32.pointAdd(l, val);
+                } else {
+                    long long expected = accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL);
+                    assert(wide.queryRange(l, r) == expected);
+                    assert(wide32.queryRange(l, r) == expected);
+                }
+            }
+            assert(wide.queryRange(0, size) == 0); // Invalid ranges
+        }
+        cout << "Test 27 passed." << endl;
     }
 
-    // Test Case 4: Edge cases - single element array
+    // Test Case 28: Leaf-bucketed trees match the element-leaf tree
     {
-        vector<int> arr = {100};
-        SegmentTree st(arr);
-        assert(st.queryRange(0, 0) == 100);
-        st.updateRange(0, 0, 50);
-        assert(st.queryRange(0, 0) == 150);
-        cout << "Test 4 passed." << endl;
+        mt19937 rng(28);
+        auto check = [&]<int BLOCK>(int size) {
+            vector<long long> arr(size);
+            for (long long& x : arr) x = (long long)(rng() % 201) - 100;
+            BucketedSegmentTree<SumMonoid<long long>, RangeAddSum<long long>, BLOCK> sums(arr);
+            BucketedSegmentTree<MinMonoid<long long>, RangeAdd<long long>, BLOCK> minima(arr);
+            BucketedSegmentTree<SumMonoid<long long>, RangeAssignAddSum<long long>, BLOCK> assigned(arr);
+            vector<long long> assigned_arr = arr; // Also sees the assignments
+            for (int op = 0; op < 1000; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                if (rng() % 4 == 0) r = min(size - 1, l + (int)(rng() % 3)); // Short ranges inside a block
+                long long val = (long long)(rng() % 21) - 10;
+                switch (rng() % 3) {
+                    case 0:
+                        for (int i = l; i <= r; ++i) {
+                            arr[i] += val;
+                            assigned_arr[i] += val;
+                        }
+                        sums.updateRange(l, r, val);
+                        minima.updateRange(l, r, val);
+                        assigned.updateRange(l, r, val);
+                        break;
+                    case 1:
+                        fill(assigned_arr.begin() + l, assigned_arr.begin() + r + 1, val);
+                        assigned.assignRange(l, r, val);
+                        break;
+                    default:
+                        assert(sums.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                        assert(minima.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                        assert(assigned.queryRange(l, r) ==
+                               accumulate(assigned_arr.begin() + l, assigned_arr.begin() + r + 1, 0LL));
+                        break;
+                }
+            }
+        };
+        for (int size : {1, 31, 32, 33, 64, 65, 1000, 5000}) {
+            check.operator()<32>(size);
+            check.operator()<64>(size);
+            check.operator()<256>(size);
+        }
+        cout << "Test 28 passed." << endl;
     }
 
-    // Test Case 5: Edge cases - update/query invalid ranges
+    // Test Case 29: Point fast paths agree with the range forms
     {
-        vector<int> arr = {1, 2, 3};
-        SegmentTree st(arr);
-        assert(st.queryRange(-1, 1) == 0);
-        assert(st.queryRange(2, 5) == 0);
-        assert(st.queryRange(3, 4) == 0);
-        st.updateRange(-1, 1, 10);
-        assert(st.queryRange(0, 2) == 1 + 2 + 3);
-        st.updateRange(2, 5, 5);
-        assert(st.queryRange(0, 2) == 1 + 2 + 3);
-        cout << "Test 5 passed." << endl;
+        mt19937 rng(29);
+        for (int size : {1, 2, 13, 64, 1000}) {
+            vector<long long> arr(size);
+            for (long long& x : arr) x = (long long)(rng() % 201) - 100;
+            SegmentTree<SumMonoid<long long>, RangeAddSum<long long>> sums(arr);
+            SegmentTree<MinMonoid<long long>, RangeAdd<long long>, BlockedLayout<4>> minima(arr);
+            IterativeSegmentTree<SumMonoid<long long>, RangeAddSum<long long>> it_sums(arr);
+            IterativeSegmentTree<MinMonoid<long long>, RangeAdd<long long>> it_minima(arr);
+            for (int op = 0; op < 2000; ++op) {
+                int l = rng() % size, r = rng() % size;
+                if (l > r) swap(l, r);
+                long long val = (long long)(rng() % 21) - 10;
+                switch (rng() % 5) {
+                    case 0: // Range update, leaves tags for the point paths to handle
+                        for (int i = l; i <= r; ++i) arr[i] += val;
+                        sums.updateRange(l, r, val);
+                        minima.updateRange(l, r, val);
+                        it_sums.updateRange(l, r, val);
+                        it_minima.updateRange(l, r, val);
+                        break;
+                    case 1:
+                        arr[l] += val;
+                        sums.pointAdd(l, val);
+                        minima.pointAdd(l, val);
+                        it_sums.pointAdd(l, val);
+                        it_minima.pointAdd(l, val);
+                        break;
+                    case 2:
+                        arr[l] = val;
+                        sums.pointSet(l, val);
+                        minima.pointSet(l, val);
+                        it_sums.pointSet(l, val);
+                        it_minima.pointSet(l, val);
+                        break;
+                    case 3: {
+                        const auto& read_only = sums;
+                        assert(read_only.pointGet(l) == arr[l]);
+                        assert(minima.pointGet(l) == arr[l]);
+                        assert(it_sums.pointGet(l) == arr[l]);
+                        assert(it_minima.pointGet(l) == arr[l]);
+                        break;
+                    }
+                    default:
+                        assert(sums.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                        assert(minima.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                        assert(it_sums.queryRange(l, r) == accumulate(arr.begin() + l, arr.begin() + r + 1, 0LL));
+                        assert(it_minima.queryRange(l, r) == *min_element(arr.begin() + l, arr.begin() + r + 1));
+                        break;
+                }
+            }
+        }
+
+        // pointSet takes an element, so aggregates with a position or a
+        // normalization get the same leaf as construction would give them
+        {
+            vector<int> elems = {4, -2, 7, 0, 3, 7};
+            using Summaries = SegmentTree<SummaryMonoid<long long>, RangeAddSummary<long long>>;
+            Summaries summaries(elems);
+            IterativeSegmentTree<SummaryMonoid<long long>, RangeAddSummary<long long>> it_summaries(elems);
+            summaries.updateRange(0, 5, 1); // Pending tags on the path
+            it_summaries.updateRange(0, 5, 1);
+            summaries.pointSet(3, 9);
+            it_summaries.pointSet(3, 9);
+            for (int& x : elems) ++x;
+            elems[3] = 9;
+            Summaries rebuilt(elems);
+            for (int l = 0; l < 6; ++l) {
+                for (int r = l; r < 6; ++r) {
+                    Summary<long long> want = rebuilt.queryRange(l, r);
+                    for (Summary<long long> got : {summaries.queryRange(l, r), it_summaries.queryRange(l, r)}) {
+                        assert(got.sum == want.sum && got.max == want.max && got.min == want.min);
+                        assert(got.argmax == want.argmax && got.argmin == want.argmin);
+                    }
+                }
+            }
+            assert(summaries.queryRange(0, 5).argmax == 3);
+
+            vector<long long> values = {5, 6, 7};
+            SegmentTree<ModSumMonoid<StaticMod<998244353>>, RangeAffineMod<StaticMod<998244353>>> mods(values);
+            mods.pointSet(1, -1LL); // Reduced like a constructor element
+            assert(mods.queryRange(1, 1) == 998244352u);
+            assert(mods.queryRange(0, 2) == 11u);
+        }
+        cout << "Test 29 passed." << endl;
     }
 
     cout << "All Segment Tree tests passed." << endl;
@@ -230,8 +4178,637 @@ void runSegmentTreeSample() {
 
 }
 
-int main() {
+// Hardware cache-miss counters for the calling thread, read through
+// perf_event_open. Counts are -1 where the kernel does not expose them
+// (non-Linux, perf_event_paranoid too high, or no PMU in a VM).
+class CacheMissCounters {
+private:
+    int fds[2] = {-1, -1}; // L1 data read misses, last-level cache misses
+
+    static int open_counter(uint32_t type, uint64_t config) {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void)type;
+        (void)config;
+        return -1;
+#endif
+    }
+
+public:
+    long long l1d_misses = -1;
+    long long llc_misses = -1;
+
+    CacheMissCounters() {
+#ifdef __linux__
+        fds[0] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+    }
+
+    ~CacheMissCounters() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+        long long* results[2] = {&l1d_misses, &llc_misses};
+        for (int i = 0; i < 2; ++i) {
+            *results[i] = -1;
+#ifdef __linux__
+            long long count;
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[i], &count, sizeof(count)) == sizeof(count)) {
+                    *results[i] = count;
+                }
+            }
+#endif
+        }
+    }
+};
+
+// Resident set size of this process in bytes, or -1 if unknown.
+long long residentBytes() {
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        long long total_pages = 0, resident_pages = 0;
+        int fields = fscanf(statm, "%lld %lld", &total_pages, &resident_pages);
+        fclose(statm);
+        if (fields == 2) {
+            return resident_pages * sysconf(_SC_PAGESIZE);
+        }
+    }
+#endif
+    return -1;
+}
+
+// Resident memory in MiB taken by a tree of type Tree over n elements
+// (the input array itself is not counted).
+template <class Tree>
+double residentTreeMiB(int n) {
+    vector<int> arr(n, 1);
+#ifdef __GLIBC__
+    malloc_trim(0); // Return memory freed by earlier trees so it is not reused unseen
+#endif
+    long long before = residentBytes();
+    Tree st(arr);
+    long long after = residentBytes();
+    if (before < 0 || after < 0) {
+        return -1;
+    }
+    return (after - before) / (1024.0 * 1024.0);
+}
+
+// Times 'ops' random operations (update_percent% range updates, the rest
+// range queries) against a tree of type Tree built over n elements.
+// Returns the average nanoseconds per operation.
+// misses: if given, also counts cache misses over the timed loop.
+template <class Tree>
+double benchmarkRandomOps(int n, int ops, unsigned long long& sink, int update_percent = 50,
+                          CacheMissCounters* misses = nullptr) {
+    vector<int> arr(n, 1);
+    Tree st(arr);
+    mt19937 rng(42);
+    if (misses) misses->start();
+    auto begin = chrono::steady_clock::now();
+    for (int op = 0; op < ops; ++op) {
+        int l = rng() % n, r = rng() % n;
+        if (l > r) swap(l, r);
+        if (op % 100 < update_percent) {
+            st.updateRange(l, r, (op & 1) ? 1 : -1);
+        } else {
+            sink += st.queryRange(l, r);
+        }
+    }
+    auto elapsed = chrono::steady_clock::now() - begin;
+    if (misses) misses->stop();
+    return chrono::duration<double, nano>(elapsed).count() / ops;
+}
+
+// Adapter that routes queryRange to the const (non-pushing) overload.
+template <class Tree>
+struct ConstQueries : Tree {
+    using Tree::Tree;
+    auto queryRange(int l, int r) { return static_cast<const Tree&>(*this).queryRange(l, r); }
+};
+
+// Compares the recursive and iterative engines for N = 1e3 ... max_n.
+void runSegmentTreeBenchmark(long long max_n) {
+    cout << "Running Segment Tree Benchmark..." << endl;
+    const int ops = 1000000;
+    unsigned long long sink = 0;
+    cout << "n,recursive_ns_per_op,iterative_ns_per_op" << endl;
+    for (long long n = 1000; n <= max_n; n *= 10) {
+        double recursive = benchmarkRandomOps<SegmentTree<>>(n, ops, sink);
+        double iterative = benchmarkRandomOps<IterativeSegmentTree<>>(n, ops, sink);
+        cout << n << "," << recursive << "," << iterative << endl;
+    }
+
+    cout << "\nAccumulator modes (recursive engine)" << endl;
+    cout << "n,int32_ns,int32x64_ns,int64_ns,int64x128_ns" << endl;
+    for (long long n = 1000; n <= max_n; n *= 10) {
+        cout << n << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>>>(n, ops, sink) << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<long long>, RangeAddSum<long long, int>>>(n, ops, sink) << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<long long>, RangeAddSum<long long>>>(n, ops, sink) << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<__int128>, RangeAddSum<__int128, long long>>>(n, ops, sink)
+             << endl;
+    }
+    cout << "bytes per node (tree + lazy): int32 8, int32x64 12, int64 16, int64x128 24" << endl;
+
+    cout << "\nNode layouts (recursive engine, random ops)" << endl;
+    cout << "n,heap_query_ns,blocked_query_ns,heap_update_ns,blocked_update_ns" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        cout << n << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout>>(n, ops, sink, 0) << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>, BlockedLayout<4>>>(n, ops, sink, 0) << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout>>(n, ops, sink, 100) << ","
+             << benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>, BlockedLayout<4>>>(n, ops, sink, 100)
+             << endl;
+    }
+
+    cout << "\nNode storage (recursive engine, 50% updates, misses per op; -1 = no perf counters)" << endl;
+    cout << "n,split_ns,packed_ns,split_l1d,packed_l1d,split_llc,packed_llc" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        CacheMissCounters split_misses, packed_misses;
+        double split = benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, SplitStorage>>(
+            n, ops, sink, 50, &split_misses);
+        double packed = benchmarkRandomOps<SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, PackedStorage>>(
+            n, ops, sink, 50, &packed_misses);
+        auto per_op = [&](long long count) { return count < 0 ? -1.0 : (double)count / ops; };
+        cout << n << "," << split << "," << packed << ","
+             << per_op(split_misses.l1d_misses) << "," << per_op(packed_misses.l1d_misses) << ","
+             << per_op(split_misses.llc_misses) << "," << per_op(packed_misses.llc_misses) << endl;
+    }
+
+    cout << "\nMemory (int sums): resident MiB per tree, and ns per random op" << endl;
+    cout << "n,recursive_4n_mib,iterative_pow2_mib,compact_2n_mib,iterative_ns,compact_ns" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        cout << n << ","
+             << residentTreeMiB<SegmentTree<>>(n) << ","
+             << residentTreeMiB<IterativeSegmentTree<>>(n) << ","
+             << residentTreeMiB<CompactSegmentTree<>>(n) << ","
+             << benchmarkRandomOps<IterativeSegmentTree<>>(n, ops, sink) << ","
+             << benchmarkRandomOps<CompactSegmentTree<>>(n, ops, sink) << endl;
+    }
+
+    cout << "\nBatched updates (recursive engine, N = min(1e6, max_n)): ns per update" << endl;
+    cout << "batch,looped_ns,batched_ns" << endl;
+    {
+        int n = (int)min(max_n, 1000000LL);
+        vector<int> arr(n, 1);
+        SegmentTree<> looped(arr), batched(arr);
+        mt19937 rng(9);
+        for (int batch_size = 10; batch_size <= 1000000; batch_size *= 10) {
+            vector<SegmentTree<>::Update> batch(batch_size);
+            for (auto& u : batch) {
+                u.l = rng() % n;
+                u.r = rng() % n;
+                if (u.l > u.r) swap(u.l, u.r);
+                u.val = (rng() % 2) ? 1 : -1;
+            }
+            int repeats = max(1, 1000000 / batch_size);
+            auto begin = chrono::steady_clock::now();
+            for (int rep = 0; rep < repeats; ++rep) {
+                for (const auto& u : batch) looped.updateRange(u.l, u.r, u.val);
+            }
+            auto middle = chrono::steady_clock::now();
+            for (int rep = 0; rep < repeats; ++rep) {
+                batched.applyBatch(batch);
+            }
+            auto end = chrono::steady_clock::now();
+            double updates = (double)repeats * batch_size;
+            cout << batch_size << ","
+                 << chrono::duration<double, nano>(middle - begin).count() / updates << ","
+                 << chrono::duration<double, nano>(end - middle).count() / updates << endl;
+        }
+        sink += looped.queryRange(0, n - 1) + batched.queryRange(0, n - 1);
+    }
+
+    cout << "\nBatched queries (recursive engine, N = min(1e6, max_n)): ns and cache misses per query" << endl;
+    cout << "batch,looped_ns,batched_ns,looped_llc,batched_llc" << endl;
+    {
+        int n = (int)min(max_n, 1000000LL);
+        vector<int> arr(n, 1);
+        SegmentTree<> st(arr);
+        mt19937 rng(10);
+        for (int batch_size = 10; batch_size <= 1000000; batch_size *= 10) {
+            vector<pair<int, int>> ranges(batch_size);
+            for (auto& [l, r] : ranges) {
+                l = rng() % n;
+                r = rng() % n;
+                if (l > r) swap(l, r);
+            }
+            vector<int> results(batch_size);
+            int repeats = max(1, 1000000 / batch_size);
+            CacheMissCounters looped_misses, batched_misses;
+            looped_misses.start();
+            auto begin = chrono::steady_clock::now();
+            for (int rep = 0; rep < repeats; ++rep) {
+                for (const auto& [l, r] : ranges) sink += st.queryRange(l, r);
+            }
+            auto middle = chrono::steady_clock::now();
+            looped_misses.stop();
+            batched_misses.start();
+            for (int rep = 0; rep < repeats; ++rep) {
+                st.queryBatch(ranges, results);
+                sink += results[0];
+            }
+            auto end = chrono::steady_clock::now();
+            batched_misses.stop();
+            double queries = (double)repeats * batch_size;
+            auto per_query = [&](long long count) { return count < 0 ? -1.0 : count / queries; };
+            cout << batch_size << ","
+                 << chrono::duration<double, nano>(middle - begin).count() / queries << ","
+                 << chrono::duration<double, nano>(end - middle).count() / queries << ","
+                 << per_query(looped_misses.llc_misses) << "," << per_query(batched_misses.llc_misses) << endl;
+        }
+    }
+
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    cout << "\nParallel build (recursive engine): ms per build by thread count, "
+         << cores << " hardware threads" << endl;
+    cout << "n,threads,build_ms,speedup" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        vector<int> arr(n, 1);
+        double single = 0;
+        for (unsigned threads = 1; threads <= cores; threads *= 2) { // More are clamped to cores
+            auto begin = chrono::steady_clock::now();
+            SegmentTree<> st(arr, threads);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+            sink += st.queryRange(0, n - 1);
+            if (threads == 1) single = ms;
+            cout << n << "," << threads << "," << ms << "," << single / ms << endl;
+        }
+    }
+
+    cout << "\nConcurrent readers with one writer (1 update per 100 queries): million queries per second" << endl;
+    cout << "n,readers,mqps" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        vector<int> arr(n, 1);
+        ConcurrentSegmentTree<> shared(arr);
+        for (unsigned readers = 1; readers <= 2 * cores; readers *= 2) {
+            atomic<bool> stop{false};
+            atomic<long long> queries{0};
+            atomic<unsigned long long> checksum{0};
+            thread writer([&] {
+                mt19937 rng(12);
+                while (!stop) {
+                    int l = rng() % n, r = rng() % n;
+                    if (l > r) swap(l, r);
+                    shared.updateRange(l, r, 1);
+                    // Wait for the readers to finish another 100 queries
+                    long long seen = queries;
+                    while (!stop && queries < seen + 100) this_thread::yield();
+                }
+            });
+            vector<thread> pool;
+            for (unsigned t = 0; t < readers; ++t) {
+                pool.emplace_back([&, t] {
+                    mt19937 rng(100 + t);
+                    unsigned long long local = 0;
+                    while (!stop) {
+                        for (int k = 0; k < 100; ++k) {
+                            int l = rng() % n, r = rng() % n;
+                            if (l > r) swap(l, r);
+                            local += shared.queryRange(l, r);
+                        }
+                        queries += 100;
+                    }
+                    checksum += local;
+                });
+            }
+            this_thread::sleep_for(chrono::milliseconds(500));
+            stop = true;
+            writer.join();
+            for (thread& reader : pool) reader.join();
+            sink += checksum;
+            cout << n << "," << readers << "," << queries / 0.5 / 1e6 << endl;
+        }
+    }
+
+    cout << "\nRead-heavy (5% updates, recursive engine): pushing vs const queries, misses per op" << endl;
+    cout << "n,pushing_ns,const_ns,pushing_l1d,const_l1d,pushing_llc,const_llc" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        CacheMissCounters pushing_misses, const_misses;
+        double pushing = benchmarkRandomOps<SegmentTree<>>(n, ops, sink, 5, &pushing_misses);
+        double read_only = benchmarkRandomOps<ConstQueries<SegmentTree<>>>(n, ops, sink, 5, &const_misses);
+        auto per_op = [&](long long count) { return count < 0 ? -1.0 : (double)count / ops; };
+        cout << n << "," << pushing << "," << read_only << ","
+             << per_op(pushing_misses.l1d_misses) << "," << per_op(const_misses.l1d_misses) << ","
+             << per_op(pushing_misses.llc_misses) << "," << per_op(const_misses.llc_misses) << endl;
+    }
+
+    cout << "\nPersistent tree: ns per versioned update, ns per query on a random version, bytes per version" << endl;
+    cout << "n,update_ns,query_ns,bytes_per_version" << endl;
+    for (long long n = 1000; n <= min(max_n, 10000000LL); n *= 10) {
+        vector<int> arr(n, 1);
+        PersistentSegmentTree<> history(arr);
+        size_t base = history.nodeCount();
+        mt19937 rng(14);
+        int updates = 200000;
+        auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < updates; ++i) {
+            int l = rng() % n, r = rng() % n;
+            if (l > r) swap(l, r);
+            history.updateRange(l, r, 1);
+        }
+        auto middle = chrono::steady_clock::now();
+        for (int i = 0; i < ops; ++i) {
+            int l = rng() % n, r = rng() % n;
+            if (l > r) swap(l, r);
+            sink += history.queryRange(rng() % history.versions(), l, r);
+        }
+        auto end = chrono::steady_clock::now();
+        double node_bytes = (double)(history.nodeCount() - base) / updates * (2 * sizeof(long long) + 2 * sizeof(int));
+        cout << n << "," << chrono::duration<double, nano>(middle - begin).count() / updates << ","
+             << chrono::duration<double, nano>(end - middle).count() / ops << "," << node_bytes << endl;
+    }
+
+    cout << "\nDynamic tree over [0, 2^63 - 1): scattered point updates, short range updates, range queries" << endl;
+    cout << "updates,point_ns,range_ns,query_ns,nodes_per_update,bytes_per_update" << endl;
+    for (long long count = 10000; count <= min(max_n, 10000000LL); count *= 10) {
+        DynamicSegmentTree<> sparse;
+        mt19937_64 rng(15);
+        auto begin = chrono::steady_clock::now();
+        for (long long i = 0; i < count; ++i) {
+            long long key = (long long)(rng() >> 1);
+            sparse.updateRange(key, key, 1);
+        }
+        auto middle = chrono::steady_clock::now();
+        long long range_updates = count / 10;
+        for (long long i = 0; i < range_updates; ++i) {
+            long long l = (long long)(rng() >> 1);
+            sparse.updateRange(l, l + (long long)(rng() % 1000000), 1);
+        }
+        auto after_ranges = chrono::steady_clock::now();
+        for (int i = 0; i < ops; ++i) {
+            long long l = (long long)(rng() >> 1), r = (long long)(rng() >> 1);
+            if (l > r) swap(l, r);
+            sink += sparse.queryRange(l, r);
+        }
+        auto end = chrono::steady_clock::now();
+        long long total = count + range_updates;
+        cout << count << "," << chrono::duration<double, nano>(middle - begin).count() / count << ","
+             << chrono::duration<double, nano>(after_ranges - middle).count() / max(range_updates, 1LL) << ","
+             << chrono::duration<double, nano>(end - after_ranges).count() / ops << ","
+             << (double)sparse.nodeCount() / total << "," << (double)sparse.memoryBytes() / total << endl;
+    }
+
+    cout << "\nPrefix search: ns per lowerBoundPrefix vs binary search over queryRange" << endl;
+    cout << "n,descent_ns,binary_search_ns" << endl;
+    for (long long n = 1000; n <= min(max_n, 10000000LL); n *= 10) {
+        vector<int> arr(n, 1);
+        SegmentTree<SumMonoid<long long>, RangeAddSum<long long>> weights(arr);
+        mt19937 rng(19);
+        for (int i = 0; i < 1000; ++i) {
+            int l = rng() % n, r = rng() % n;
+            if (l > r) swap(l, r);
+            weights.updateRange(l, r, rng() % 3);
+        }
+        long long total = weights.queryRange(0, n - 1);
+        const int searches = 200000;
+        vector<long long> targets(searches);
+        for (long long& x : targets) x = 1 + (long long)(rng() % total);
+        auto begin = chrono::steady_clock::now();
+        for (long long x : targets) {
+            sink += weights.lowerBoundPrefix(x);
+        }
+        auto middle = chrono::steady_clock::now();
+        for (long long x : targets) {
+            int lo = 0, hi = n - 1; // Smallest i with prefix sum >= x
+            while (lo < hi) {
+                int mid = lo + (hi - lo) / 2;
+                if (weights.queryRange(0, mid) >= x) hi = mid; else lo = mid + 1;
+            }
+            sink += lo;
+        }
+        auto end = chrono::steady_clock::now();
+        cout << n << "," << chrono::duration<double, nano>(middle - begin).count() / searches << ","
+             << chrono::duration<double, nano>(end - middle).count() / searches << endl;
+    }
+
+    cout << "\nSum + max + min with positions: one Summary tree vs three separate trees, ns per op" << endl;
+    cout << "n,summary_ns,separate_ns" << endl;
+    for (long long n = 1000; n <= min(max_n, 10000000LL); n *= 10) {
+        vector<long long> arr(n, 1);
+        SegmentTree<SummaryMonoid<long long>, RangeAddSummary<long long>> summary(arr);
+        SegmentTree<SumMonoid<long long>, RangeAddSum<long long>> sums(arr);
+        SegmentTree<MaxMonoid<long long>, RangeAdd<long long>> maxima(arr);
+        SegmentTree<MinMonoid<long long>, RangeAdd<long long>> minima(arr);
+        auto run = [&](auto&& update, auto&& query) {
+            mt19937 rng(20);
+            auto begin = chrono::steady_clock::now();
+            for (int op = 0; op < ops; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (op & 1) {
+                    update(l, r, (op & 2) ? 1 : -1);
+                } else {
+                    query(l, r);
+                }
+            }
+            return chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count() / ops;
+        };
+        double one = run([&](int l, int r, long long v) { summary.updateRange(l, r, v); },
+                         [&](int l, int r) {
+                             Summary<long long> s = summary.queryRange(l, r);
+                             sink += s.sum + s.max + s.min + s.argmax + s.argmin;
+                         });
+        double three = run([&](int l, int r, long long v) {
+                               sums.updateRange(l, r, v);
+                               maxima.updateRange(l, r, v);
+                               minima.updateRange(l, r, v);
+                           },
+                           [&](int l, int r) {
+                               sink += sums.queryRange(l, r) + maxima.queryRange(l, r) + minima.queryRange(l, r);
+                           });
+        cout << n << "," << one << "," << three << endl;
+    }
+
+    // Baseline for the modular policies: % by a modulus only known at run time
+    struct DivisionMod {
+        static uint32_t& m() {
+            static uint32_t modulus = 998244353;
+            return modulus;
+        }
+        static uint32_t modulus() { return m(); }
+        static uint32_t add(uint32_t a, uint32_t b) {
+            uint32_t c = a + b;
+            return c >= m() ? c - m() : c;
+        }
+        static uint32_t mul(uint32_t a, uint32_t b) { return (uint32_t)((uint64_t)a * b % m()); }
+    };
+    volatile uint32_t runtime_modulus = 998244353; // Keep the compiler from seeing the constant
+    DivisionMod::m() = runtime_modulus;
+    BarrettMod<>::setModulus(runtime_modulus);
+    cout << "\nAffine updates mod 998244353: compile-time modulus, Barrett, hardware division, ns per op" << endl;
+    cout << "n,static_ns,barrett_ns,division_ns" << endl;
+    auto benchmarkAffine = [&]<class Mod>(long long n) {
+        vector<int> arr(n, 1);
+        SegmentTree<ModSumMonoid<Mod>, RangeAffineMod<Mod>> st(arr);
+        mt19937 rng(21);
+        auto begin = chrono::steady_clock::now();
+        for (int op = 0; op < ops; ++op) {
+            int l = rng() % n, r = rng() % n;
+            if (l > r) swap(l, r);
+            if (op & 1) {
+                st.updateRange(l, r, AffineTag{(uint32_t)(op % 1000 + 2), (uint32_t)op});
+            } else {
+                sink += st.queryRange(l, r);
+            }
+        }
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count() / ops;
+    };
+    for (long long n = 1000; n <= min(max_n, 10000000LL); n *= 10) {
+        cout << n << "," << benchmarkAffine.operator()<StaticMod<998244353>>(n) << ","
+             << benchmarkAffine.operator()<BarrettMod<>>(n) << ","
+             << benchmarkAffine.operator()<DivisionMod>(n) << endl;
+    }
+
+    cout << "\nWide 16-ary tree vs SegmentTree (int sums): ns per range query and per point add" << endl;
+    cout << "n,wide_query_ns,recursive_query_ns,wide_add_ns,recursive_add_ns" << endl;
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        vector<int> arr(n, 1);
+        auto run = [&](auto& st, bool updates) {
+            mt19937 rng(23);
+            auto begin = chrono::steady_clock::now();
+            for (int op = 0; op < ops; ++op) {
+                int l = rng() % n, r = rng() % n;
+                if (l > r) swap(l, r);
+                if (!updates) {
+                    sink += st.queryRange(l, r);
+                } else if constexpr (requires { st.pointAdd(l, 1); }) {
+                    st.pointAdd(l, 1);
+                } else {
+                    st.updateRange(l, l, 1);
+                }
+            }
+            return chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count() / ops;
+        };
+        double wide_query, wide_add, recursive_query = -1, recursive_add = -1;
+        {
+            WideSegmentTree<int> wide(arr);
+            wide_query = run(wide, false);
+            wide_add = run(wide, true);
+        }
+        if (n <= 100000000) { // The 4N tree needs 8 bytes per slot: 32 GB at 1e9
+            SegmentTree<> recursive(arr);
+            recursive_query = run(recursive, false);
+            recursive_add = run(recursive, true);
+        }
+        cout << n << "," << wide_query << "," << recursive_query << "," << wide_add << "," << recursive_add << endl;
+    }
+
+    cout << "\nLeaf buckets: ns per op (50% updates) and resident MiB, element leaves vs blocks of 32/64/256" << endl;
+    cout << "n,leaves_ns,block32_ns,block64_ns,block256_ns,leaves_MiB,block64_MiB" << endl;
+    for (long long n = 1000; n <= max_n; n *= 10) {
+        cout << n << "," << benchmarkRandomOps<SegmentTree<>>(n, ops, sink) << ","
+             << benchmarkRandomOps<BucketedSegmentTree<SumMonoid<int>, RangeAddSum<int>, 32>>(n, ops, sink) << ","
+             << benchmarkRandomOps<BucketedSegmentTree<SumMonoid<int>, RangeAddSum<int>, 64>>(n, ops, sink) << ","
+             << benchmarkRandomOps<BucketedSegmentTree<SumMonoid<int>, RangeAddSum<int>, 256>>(n, ops, sink) << ","
+             << residentTreeMiB<SegmentTree<>>(n) << ","
+             << residentTreeMiB<BucketedSegmentTree<>>(n) << endl;
+    }
+
+    cout << "\nPoint operations: ns per pointAdd/pointGet vs updateRange(i, i)/queryRange(i, i)" << endl;
+    cout << "n,recursive_add_ns,recursive_range_update_ns,recursive_get_ns,recursive_range_query_ns,"
+         << "iterative_add_ns,iterative_range_update_ns,iterative_get_ns,iterative_range_query_ns" << endl;
+    auto benchmarkPoints = [&](auto& st, long long n, int mode) {
+        mt19937 rng(25);
+        auto begin = chrono::steady_clock::now();
+        for (int op = 0; op < ops; ++op) {
+            int i = rng() % n;
+            switch (mode) {
+                case 0: st.pointAdd(i, 1); break;
+                case 1: st.updateRange(i, i, 1); break;
+                case 2: sink += st.pointGet(i); break;
+                default: sink += st.queryRange(i, i); break;
+            }
+        }
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count() / ops;
+    };
+    for (long long n = 1000; n <= max_n; n *= 10) {
+        vector<int> arr(n, 1);
+        cout << n;
+        {
+            SegmentTree<> st(arr);
+            st.updateRange(0, n - 1, 1); // Leave tags for the point paths to push
+            for (int mode = 0; mode < 4; ++mode) cout << "," << benchmarkPoints(st, n, mode);
+        }
+        {
+            IterativeSegmentTree<> st(arr);
+            st.updateRange(0, n - 1, 1);
+            for (int mode = 0; mode < 4; ++mode) cout << "," << benchmarkPoints(st, n, mode);
+        }
+        cout << endl;
+    }
+
+#ifdef __linux__
+    cout << "\nStartup: build from the array vs open a saved file (mapped read-only), ms" << endl;
+    cout << "n,build_ms,save_ms,open_ms,first_queries_ms,file_MiB" << endl;
+    string path = (filesystem::temp_directory_path() / "segment_tree_bench.bin").string();
+    for (long long n = 1000000; n <= max_n; n *= 10) {
+        vector<int> arr(n, 1);
+        auto ms = [](auto from, auto to) { return chrono::duration<double, milli>(to - from).count(); };
+        auto begin = chrono::steady_clock::now();
+        SegmentTree<> built(arr);
+        auto after_build = chrono::steady_clock::now();
+        built.save(path);
+        auto after_save = chrono::steady_clock::now();
+        const SegmentTree<SumMonoid<int>, RangeAddSum<int>, HeapLayout, MappedStorage> mapped(path);
+        auto after_open = chrono::steady_clock::now();
+        mt19937 rng(16);
+        for (int i = 0; i < 1000; ++i) {
+            int l = rng() % n, r = rng() % n;
+            if (l > r) swap(l, r);
+            sink += mapped.queryRange(l, r);
+        }
+        auto end = chrono::steady_clock::now();
+        cout << n << "," << ms(begin, after_build) << "," << ms(after_build, after_save) << ","
+             << ms(after_save, after_open) << "," << ms(after_open, end) << ","
+             << (double)filesystem::file_size(path) / (1 << 20) << endl;
+    }
+    filesystem::remove(path);
+#endif
+    cout << "(checksum " << sink << ")" << endl;
+}
+
+// segment_tree_benchmark.cc defines SEGMENT_TREE_NO_MAIN to include this file with its own main
+#ifndef SEGMENT_TREE_NO_MAIN
+int main(int argc, char** argv) {
+    // Usage: segment_tree [--bench [max_n]]
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runSegmentTreeBenchmark(argc > 2 ? atoll(argv[2]) : 100000000);
+        return 0;
+    }
     runSegmentTreeTests();
     runSegmentTreeSample();
     return 0;
-}
\ No newline at end of file
+}
+#endif
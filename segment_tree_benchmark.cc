@@ -0,0 +1,163 @@
+// Google Benchmark suite for the segment tree engines.
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread segment_tree_benchmark.cc -lbenchmark -o segment_tree_benchmark
+// Run:
+//   ./segment_tree_benchmark [--max_n=N] [benchmark flags]
+//   --max_n=N          largest array size, sizes are 1e3, 1e4, ... N (default 1e7,
+//                      at most 2^30, so up to 1e9; 1e9 needs about 40 GB for the
+//                      recursive engine and 16 GB for the iterative one)
+//   --benchmark_format=json, --benchmark_out=results.json --benchmark_out_format=csv,
+//   --benchmark_filter=RangeQuery/... and the other Google Benchmark flags work as usual.
+//
+// Benchmark names are Operation/engine/pattern/n, e.g. RangeQuery/iterative/random/1000000.
+// Per-operation time is the reported time; items_per_second counts
+// operations (elements for Build).
+
+#define SEGMENT_TREE_NO_MAIN
+#include "segment_tree.cc"
+
+#include <benchmark/benchmark.h>
+
+// One pre-generated operation: a range, and whether it is an update
+struct BenchOp {
+    int l, r;
+    bool update;
+};
+
+enum class OpKind { PointUpdate, RangeUpdate, PointQuery, RangeQuery, Mixed };
+
+// Generates 'count' operations over [0, n).
+// kind: point or range operations; Mixed draws ranges and makes
+//       update_percent% of them updates
+// sequential: same operations, sorted by left end, so consecutive
+//             operations touch neighbouring leaves
+vector<BenchOp> makeBenchOps(int n, size_t count, OpKind kind, int update_percent, bool sequential) {
+    mt19937 rng(17);
+    vector<BenchOp> ops(count);
+    for (BenchOp& op : ops) {
+        op.l = rng() % n;
+        op.r = op.l;
+        if (kind != OpKind::PointUpdate && kind != OpKind::PointQuery) {
+            op.r = rng() % n;
+            if (op.l > op.r) swap(op.l, op.r);
+        }
+        switch (kind) {
+            case OpKind::PointUpdate:
+            case OpKind::RangeUpdate:
+                op.update = true;
+                break;
+            case OpKind::PointQuery:
+            case OpKind::RangeQuery:
+                op.update = false;
+                break;
+            default:
+                op.update = (int)(rng() % 100) < update_percent;
+                break;
+        }
+    }
+    if (sequential) {
+        stable_sort(ops.begin(), ops.end(), [](const BenchOp& a, const BenchOp& b) { return a.l < b.l; });
+    }
+    return ops;
+}
+
+// Time to build a tree of type Tree over n elements; items are elements
+template <class Tree>
+void benchmarkBuild(benchmark::State& state, int n) {
+    vector<int> arr(n, 1);
+    for (auto _ : state) {
+        Tree st(arr);
+        benchmark::DoNotOptimize(&st);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)n);
+}
+
+// Time per operation of a pre-generated workload against a tree of type
+// Tree over n elements. The operations are replayed in a loop; building the
+// tree and generating the operations are not timed.
+// point_path: run point operations through pointAdd/pointGet instead of
+//             updateRange(i, i)/queryRange(i, i)
+template <class Tree>
+void benchmarkOps(benchmark::State& state, int n, OpKind kind, int update_percent, bool sequential,
+                  bool point_path) {
+    const size_t COUNT = 1 << 16; // Power of two, so the replay index is a mask
+    vector<BenchOp> ops = makeBenchOps(n, COUNT, kind, update_percent, sequential);
+    vector<int> arr(n, 1);
+    Tree st(arr);
+    size_t i = 0;
+    for (auto _ : state) {
+        const BenchOp& op = ops[i++ & (COUNT - 1)];
+        if (point_path && op.update) {
+            st.pointAdd(op.l, (i & 1) ? 1 : -1);
+        } else if (point_path) {
+            benchmark::DoNotOptimize(st.pointGet(op.l));
+        } else if (op.update) {
+            st.updateRange(op.l, op.r, (i & 1) ? 1 : -1);
+        } else {
+            benchmark::DoNotOptimize(st.queryRange(op.l, op.r));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Registers every operation and access pattern of one engine for n = 1e3 ... max_n
+template <class Tree>
+void registerEngine(const string& engine, long long max_n) {
+    struct Workload {
+        const char* name;
+        OpKind kind;
+        int update_percent;
+        bool point_path;
+    };
+    const Workload workloads[] = {
+        {"PointUpdate", OpKind::PointUpdate, 100, false}, // updateRange(i, i, v)
+        {"PointAdd", OpKind::PointUpdate, 100, true},     // pointAdd(i, v)
+        {"RangeUpdate", OpKind::RangeUpdate, 100, false},
+        {"PointQuery", OpKind::PointQuery, 0, false},     // queryRange(i, i)
+        {"PointGet", OpKind::PointQuery, 0, true},        // pointGet(i)
+        {"RangeQuery", OpKind::RangeQuery, 0, false},
+        {"Mixed10Update", OpKind::Mixed, 10, false},
+        {"Mixed50Update", OpKind::Mixed, 50, false},
+        {"Mixed90Update", OpKind::Mixed, 90, false},
+    };
+    for (long long n = 1000; n <= max_n; n *= 10) {
+        string size = "/" + to_string(n);
+        benchmark::RegisterBenchmark(("Build/" + engine + size).c_str(), benchmarkBuild<Tree>, (int)n)
+            ->Unit(benchmark::kMillisecond);
+        for (const Workload& w : workloads) {
+            for (bool sequential : {false, true}) {
+                string name = string(w.name) + "/" + engine + (sequential ? "/sequential" : "/random") + size;
+                benchmark::RegisterBenchmark(name.c_str(), benchmarkOps<Tree>, (int)n, w.kind,
+                                             w.update_percent, sequential, w.point_path);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    // Take --max_n=N out of argv before Google Benchmark sees it. Both engines
+    // take any n up to 2^30 (the recursive one's int node indices stay below 2^31).
+    long long max_n = 10000000;
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.rfind("--max_n=", 0) == 0) {
+            max_n = min(atoll(arg.c_str() + 8), 1LL << 30);
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    registerEngine<SegmentTree<>>("recursive", max_n);
+    registerEngine<IterativeSegmentTree<>>("iterative", max_n);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}